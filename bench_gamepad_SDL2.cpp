@@ -0,0 +1,318 @@
+/*
+ * Benchmarks of the sdljoytest input hot paths.
+ * Linked with test_gamepad_SDL2.cpp built with __SDLJOYTEST_NO_MAIN, so the
+ * event dispatch measured is the real main loop switch.
+ *
+ * Output is one JSON object per line on stdout. Every benchmark runs a fixed
+ * number of iterations BENCH_RUNS times with fixed random seeds, and reports
+ * the fastest and the median run so results can be compared over time.
+ *
+ * (c) Wintermute0110 <wintermute0110@gmail.com> 2019
+ */
+#include <SDL2/SDL.h>
+#include <unistd.h>
+#include "test_gamepad_SDL2.h"
+#include "mapping_SDL2.h"
+
+#define BENCH_RUNS 7
+
+// Benchmark output. stdout is sent to /dev/null, the dispatch benchmarks print.
+FILE *bench_out = NULL;
+volatile Sint64 bench_sink = 0;
+
+typedef void (*BenchFunc)(int iterations, void *param);
+typedef void (*BenchReset)(void);
+
+// Run func BENCH_RUNS times and print the fastest and the median time per operation.
+// reset, if not NULL, is called untimed before the warm up and before every run.
+void Bench_Run(const char *name, const char *kind, BenchFunc func, BenchReset reset,
+               int iterations, void *param)
+{
+	double ns[BENCH_RUNS], freq = (double)SDL_GetPerformanceFrequency();
+	int r, i, j;
+
+	if (reset)
+		reset();
+	func(iterations < 100 ? iterations : 100, param); // Warm up
+	for (r = 0; r < BENCH_RUNS; r++) {
+		Uint64 t0;
+
+		if (reset)
+			reset();
+		t0 = SDL_GetPerformanceCounter();
+
+		func(iterations, param);
+		ns[r] = (SDL_GetPerformanceCounter() - t0) * 1e9 / freq / iterations;
+	}
+	for (i = 1; i < BENCH_RUNS; i++) {
+		double v = ns[i];
+
+		for (j = i; j > 0 && ns[j - 1] > v; j--)
+			ns[j] = ns[j - 1];
+		ns[j] = v;
+	}
+	fprintf(bench_out, "{\"bench\":\"%s\",\"kind\":\"%s\",\"runs\":%i,\"iterations\":%i,"
+	        "\"ns_per_op_min\":%.2f,\"ns_per_op_median\":%.2f}\n",
+	        name, kind, BENCH_RUNS, iterations, ns[0], ns[BENCH_RUNS / 2]);
+	fflush(bench_out);
+}
+
+//
+// Event dispatch through the test_gamepad_SDL2 main loop switch
+//
+#define DISPATCH_EVENTS 1024
+
+typedef struct DispatchParam
+{
+	SDL_Event events[DISPATCH_EVENTS];
+}DispatchParam;
+
+void Bench_Dispatch(int iterations, void *param)
+{
+	DispatchParam *p = (DispatchParam *)param;
+	int i;
+
+	for (i = 0; i < iterations; i++)
+		SDL2_Process_Event(&p->events[i & (DISPATCH_EVENTS - 1)]);
+}
+
+void Bench_Dispatch_Init(DispatchParam *p, Uint32 type, Uint32 seed)
+{
+	int i;
+
+	SDL_memset(p, 0, sizeof(*p));
+	for (i = 0; i < DISPATCH_EVENTS; i++) {
+		SDL_Event *ev = &p->events[i];
+		Uint32 rnd = SDL2_Random(&seed);
+
+		ev->type = type;
+		switch (type) {
+			case SDL_JOYAXISMOTION:
+				ev->jaxis.axis = rnd % 6;
+				ev->jaxis.value = (Sint16)(rnd >> 8);
+				break;
+			case SDL_JOYBUTTONDOWN:
+				ev->jbutton.button = rnd % 16;
+				ev->jbutton.state = SDL_PRESSED;
+				break;
+			case SDL_JOYHATMOTION:
+				ev->jhat.value = rnd % 16;
+				break;
+			case SDL_CONTROLLERAXISMOTION:
+				ev->caxis.axis = rnd % SDL_CONTROLLER_AXIS_MAX;
+				ev->caxis.value = (Sint16)(rnd >> 8);
+				break;
+			case SDL_CONTROLLERBUTTONDOWN:
+				ev->cbutton.button = rnd % SDL_CONTROLLER_BUTTON_MAX;
+				ev->cbutton.state = SDL_PRESSED;
+				break;
+		}
+	}
+}
+
+//
+// Mapping string assembly. Same step table and append as map_gamepad_SDL2,
+// 21 steps into the 4 KB mapping buffer.
+//
+void Bench_Mapping_Init(MappingStep *steps)
+{
+	int s, button = 0, axis = 0;
+
+	SDL_memcpy(steps, mapping_steps, sizeof(mapping_steps));
+	for (s = 0; s < MAPPING_NUM_STEPS; s++) {
+		if (steps[s].marker == MARKER_AXIS) {
+			steps[s].axis = axis++;
+		} else if (SDL_strcmp(steps[s].field, "dpleft") == 0) {
+			// D-pad on the hat, as most pads report it
+			steps[s].hat = 0;
+			steps[s].hat_value = SDL_HAT_LEFT;
+		} else if (SDL_strcmp(steps[s].field, "dpdown") == 0) {
+			steps[s].hat = 0;
+			steps[s].hat_value = SDL_HAT_DOWN;
+		} else if (SDL_strcmp(steps[s].field, "dpright") == 0) {
+			steps[s].hat = 0;
+			steps[s].hat_value = SDL_HAT_RIGHT;
+		} else if (SDL_strcmp(steps[s].field, "dpup") == 0) {
+			steps[s].hat = 0;
+			steps[s].hat_value = SDL_HAT_UP;
+		} else {
+			steps[s].button = button++;
+		}
+	}
+}
+
+void Bench_Mapping(int iterations, void *param)
+{
+	MappingStep *steps = (MappingStep *)param;
+	char mapping[4096];
+	int i, s;
+
+	for (i = 0; i < iterations; i++) {
+		SDL_snprintf(mapping, SDL_arraysize(mapping), "%s,%s,platform:%s,",
+		             "030000005e0400008e02000014010000", "Benchmark Joystick", "Linux");
+		for (s = 0; s < MAPPING_NUM_STEPS; s++) {
+			steps[s].mapping_offset = SDL_strlen(mapping);
+			Mapping_Append(mapping, SDL_arraysize(mapping), &steps[s]);
+		}
+		bench_sink += mapping[i & 255];
+	}
+}
+
+//
+// Dead zone filtering of the main loop axis cases
+//
+#define DEADZONE_VALUES 65536
+
+void Bench_Deadzone(int iterations, void *param)
+{
+	const Sint16 *values = (const Sint16 *)param;
+	Sint64 passed = 0;
+	int i;
+
+	for (i = 0; i < iterations; i++) {
+		Sint16 v = values[i & (DEADZONE_VALUES - 1)];
+
+		if (SDL2_Dead_Zone_Passes(v))
+			passed++;
+	}
+	bench_sink += passed;
+}
+
+//
+// Controller DB loading
+//
+#define DB_MAPPINGS 2000
+
+// Start from the built-in mappings only, so every load adds new mappings.
+// Quitting the controller subsystem quits the joystick one, which frees the
+// mapping list. Only valid while nothing else holds the joystick subsystem.
+void Bench_DB_Reset(void)
+{
+	SDL_QuitSubSystem(SDL_INIT_GAMECONTROLLER);
+	if (SDL_InitSubSystem(SDL_INIT_GAMECONTROLLER))
+		fprintf(stderr, "SDL_InitSubSystem() failed: %s\n", SDL_GetError());
+}
+
+void Bench_DB_Load(int iterations, void *param)
+{
+	const char *path = (const char *)param;
+	int i;
+
+	for (i = 0; i < iterations; i++)
+		bench_sink += SDL_GameControllerAddMappingsFromFile(path);
+}
+
+int Bench_DB_Write(const char *path)
+{
+	FILE *f = fopen(path, "w");
+	int i;
+
+	if (!f)
+		return -1;
+	fprintf(f, "# Generated by bench_gamepad_SDL2\n");
+	for (i = 0; i < DB_MAPPINGS; i++) {
+		fprintf(f, "03000000%08x0000%08x0000,Bench Pad %i,a:b0,b:b1,x:b2,y:b3,back:b6,guide:b8,"
+		        "start:b7,leftstick:b9,rightstick:b10,leftshoulder:b4,rightshoulder:b5,"
+		        "dpup:h0.1,dpdown:h0.4,dpleft:h0.8,dpright:h0.2,leftx:a0,lefty:a1,"
+		        "rightx:a3,righty:a4,lefttrigger:a2,righttrigger:a5,platform:Linux,\n",
+		        i, i * 7919, i);
+	}
+	fclose(f);
+
+	return 0;
+}
+
+#if SDL_VERSION_ATLEAST(2, 0, 14)
+//
+// Hotplug: attach a virtual gamepad, open and close it, detach it
+//
+void Bench_Hotplug(int iterations, void *param)
+{
+	int i;
+
+	for (i = 0; i < iterations; i++) {
+		int device_index = SDL_JoystickAttachVirtual(SDL_JOYSTICK_TYPE_GAMECONTROLLER, 6, 15, 1);
+		SDL_GameController *pad;
+
+		if (device_index < 0)
+			continue;
+		pad = SDL_GameControllerOpen(device_index);
+		if (pad)
+			SDL_GameControllerClose(pad);
+		SDL_JoystickDetachVirtual(device_index);
+		SDL_FlushEvents(SDL_FIRSTEVENT, SDL_LASTEVENT);
+	}
+}
+#endif
+
+int main(int argn, char** argv)
+{
+	static DispatchParam dispatch;
+	static Sint16 deadzone_values[DEADZONE_VALUES];
+	static MappingStep mapping_steps_bench[MAPPING_NUM_STEPS];
+	const char *db_path = "/tmp/sdljoytest_bench_db.txt";
+	Uint32 seed = 0x2545F491;
+	int i;
+
+	// Keep the real stdout for the results, the dispatch switch prints
+	bench_out = fdopen(dup(fileno(stdout)), "w");
+	if (!bench_out || !freopen("/dev/null", "w", stdout)) {
+		fprintf(stderr, "Cannot redirect stdout\n");
+		return 1;
+	}
+
+	// Game controller implies joystick. Not initialising the joystick on its
+	// own lets Bench_DB_Reset() clear the mapping list.
+	if (SDL_Init(SDL_INIT_GAMECONTROLLER)) {
+		fprintf(stderr, "SDL_Init() failed: %s\n", SDL_GetError());
+		return 1;
+	}
+
+	Bench_Dispatch_Init(&dispatch, SDL_JOYAXISMOTION, seed);
+	Bench_Run("dispatch_joy_axis", "micro", Bench_Dispatch, NULL, 200000, &dispatch);
+	Bench_Dispatch_Init(&dispatch, SDL_JOYBUTTONDOWN, seed);
+	Bench_Run("dispatch_joy_button", "micro", Bench_Dispatch, NULL, 200000, &dispatch);
+	Bench_Dispatch_Init(&dispatch, SDL_JOYHATMOTION, seed);
+	Bench_Run("dispatch_joy_hat", "micro", Bench_Dispatch, NULL, 200000, &dispatch);
+	Bench_Dispatch_Init(&dispatch, SDL_CONTROLLERAXISMOTION, seed);
+	Bench_Run("dispatch_controller_axis", "micro", Bench_Dispatch, NULL, 200000, &dispatch);
+	Bench_Dispatch_Init(&dispatch, SDL_CONTROLLERBUTTONDOWN, seed);
+	Bench_Run("dispatch_controller_button", "micro", Bench_Dispatch, NULL, 200000, &dispatch);
+
+	// Structured output of the same controller axis events
+	Bench_Dispatch_Init(&dispatch, SDL_CONTROLLERAXISMOTION, seed);
+	SDL2_Output_Init(OUTPUT_JSONL, stdout);
+	Bench_Run("dispatch_controller_axis_jsonl", "micro", Bench_Dispatch, NULL, 200000, &dispatch);
+	SDL2_Output_Flush();
+	SDL2_Output_Init(OUTPUT_CSV, stdout);
+	Bench_Run("dispatch_controller_axis_csv", "micro", Bench_Dispatch, NULL, 200000, &dispatch);
+	SDL2_Output_Flush();
+	SDL2_Output_Init(OUTPUT_BINARY, stdout);
+	Bench_Run("dispatch_controller_axis_binary", "micro", Bench_Dispatch, NULL, 200000, &dispatch);
+	SDL2_Output_Flush();
+	SDL2_Output_Init(OUTPUT_TEXT, stdout);
+
+	Bench_Mapping_Init(mapping_steps_bench);
+	Bench_Run("mapping_assembly", "micro", Bench_Mapping, NULL, 20000, mapping_steps_bench);
+
+	for (i = 0; i < DEADZONE_VALUES; i++)
+		deadzone_values[i] = (Sint16)(SDL2_Random(&seed) >> 8);
+	Bench_Run("deadzone_filter", "micro", Bench_Deadzone, NULL, 10000000, deadzone_values);
+
+	if (Bench_DB_Write(db_path) == 0) {
+		Bench_Run("db_load_2000_mappings", "macro", Bench_DB_Load, Bench_DB_Reset, 1, (void *)db_path);
+		remove(db_path);
+		Bench_DB_Reset(); // Hotplug on the built-in mappings only
+	} else {
+		fprintf(stderr, "Cannot write %s, skipping DB benchmark\n", db_path);
+	}
+
+#if SDL_VERSION_ATLEAST(2, 0, 14)
+	Bench_Run("hotplug_virtual_open_close", "macro", Bench_Hotplug, NULL, 200, NULL);
+#endif
+
+	SDL_Quit();
+	fclose(bench_out);
+
+	return 0;
+}
@@ -0,0 +1,205 @@
+/*
+ * Client for test_gamepad_SDL2 -daemon.
+ * Reads joystick/controller events from the daemon shared memory ring. Many
+ * clients can run at the same time, each one with its own read cursor.
+ * Exits when the daemon exits or is restarted.
+ *
+ * Options:
+ *  -list                    List the devices owned by the daemon and exit
+ *  -device N                Only print events of joystick instance id N
+ *  -rumble N S MS           Rumble instance id N with strength S (0-100) for MS ms and exit
+ *
+ * (c) Wintermute0110 <wintermute0110@gmail.com> 2019
+ */
+#include <SDL2/SDL.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "gamepad_ring_SDL2.h"
+
+#define CLIENT_HEARTBEAT_MS 1000 // Daemon considered hung without heartbeat for this long
+
+// Send one command to the daemon control socket and print the reply.
+// Returns 0 if the daemon answered "ok" (or "end" for a list).
+int Client_Command(const char *cmd, char *reply, int reply_size)
+{
+	struct sockaddr_un addr;
+	int fd, len, total = 0;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("socket()");
+		return -1;
+	}
+	SDL_memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	SDL_strlcpy(addr.sun_path, GAMEPAD_RING_SOCKET, sizeof(addr.sun_path));
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		printf("Cannot connect to %s. Is test_gamepad_SDL2 -daemon running?\n", GAMEPAD_RING_SOCKET);
+		close(fd);
+		return -1;
+	}
+	send(fd, cmd, SDL_strlen(cmd), MSG_NOSIGNAL);
+	while (total < reply_size - 1 && (len = recv(fd, reply + total, reply_size - 1 - total, 0)) > 0)
+		total += len;
+	reply[total] = '\0';
+	close(fd);
+
+	return strncmp(reply, "error", 5) == 0 ? -1 : 0;
+}
+
+int main(int argn, char** argv)
+{
+	char cmd[256], reply[4096];
+	int device = -1, i;
+	bool list = false, rumble = false;
+	int rumble_strength = 0, rumble_ms = 0;
+
+	for (i = 1; i < argn; i++) {
+		if (strcmp(argv[i], "-list") == 0) {
+			list = true;
+		} else if (strcmp(argv[i], "-device") == 0 && i + 1 < argn) {
+			device = SDL_atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-rumble") == 0 && i + 3 < argn) {
+			rumble = true;
+			device = SDL_atoi(argv[++i]);
+			rumble_strength = SDL_atoi(argv[++i]);
+			rumble_ms = SDL_atoi(argv[++i]);
+		} else {
+			printf("Unknown option '%s'\n", argv[i]);
+			return 1;
+		}
+	}
+
+	if (list) {
+		int ret = Client_Command("list\n", reply, sizeof(reply));
+
+		printf("%s", reply);
+		return ret ? 1 : 0;
+	}
+	if (rumble) {
+		int ret;
+
+		SDL_snprintf(cmd, sizeof(cmd), "rumble %i %i %i\n", device, rumble_strength, rumble_ms);
+		ret = Client_Command(cmd, reply, sizeof(reply));
+		printf("%s", reply);
+		return ret ? 1 : 0;
+	}
+
+	//
+	// Map the event ring
+	//
+	int shm_fd = shm_open(GAMEPAD_RING_SHM_NAME, O_RDONLY, 0);
+	if (shm_fd < 0) {
+		printf("Cannot open %s. Is test_gamepad_SDL2 -daemon running?\n", GAMEPAD_RING_SHM_NAME);
+		return 1;
+	}
+	const GamepadRing *ring = (const GamepadRing *)mmap(NULL, sizeof(GamepadRing), PROT_READ,
+	                                                    MAP_SHARED, shm_fd, 0);
+	if (ring == MAP_FAILED) {
+		perror("mmap()");
+		return 1;
+	}
+	if (ring->magic != GAMEPAD_RING_MAGIC || ring->version != GAMEPAD_RING_VERSION ||
+	    ring->slots != GAMEPAD_RING_SLOTS) {
+		printf("Event ring %s has an incompatible layout\n", GAMEPAD_RING_SHM_NAME);
+		return 1;
+	}
+	Uint64 generation = __atomic_load_n(&ring->generation, __ATOMIC_ACQUIRE);
+	if (!GamepadRing_Alive(ring, generation)) {
+		printf("Event ring %s is not owned by a running daemon\n", GAMEPAD_RING_SHM_NAME);
+		return 1;
+	}
+
+	//
+	// Subscribe. The reply is the cursor to start reading from.
+	//
+	if (device >= 0)
+		SDL_snprintf(cmd, sizeof(cmd), "subscribe %i\n", device);
+	else
+		SDL_snprintf(cmd, sizeof(cmd), "subscribe all\n");
+	if (Client_Command(cmd, reply, sizeof(reply)) != 0) {
+		printf("%s", reply);
+		return 1;
+	}
+	Uint64 cursor = SDL_strtoull(reply + 3, NULL, 10);
+	Uint64 lost = 0, lost_reported = 0;
+	Uint64 heartbeat = __atomic_load_n(&ring->heartbeat, __ATOMIC_ACQUIRE);
+	Uint32 heartbeat_ticks = SDL_GetTicks();
+	bool hung = false;
+	SDL_Event ev;
+
+	printf("Subscribed to %s at event %llu. Press CTRL+C to exit.\n",
+	       device >= 0 ? "one device" : "all devices", (unsigned long long)cursor);
+	for (;;) {
+		if (!GamepadRing_Read(ring, &cursor, &ev, &lost)) {
+			Uint64 beat = __atomic_load_n(&ring->heartbeat, __ATOMIC_ACQUIRE);
+
+			// The ring is only reset or abandoned while there are no new events
+			if (!GamepadRing_Alive(ring, generation)) {
+				printf("Daemon exited or was restarted. Exiting.\n");
+				return 1;
+			}
+			if (beat != heartbeat) {
+				if (hung)
+					printf("Daemon is running again\n");
+				heartbeat = beat;
+				heartbeat_ticks = SDL_GetTicks();
+				hung = false;
+			} else if (!hung && SDL_GetTicks() - heartbeat_ticks > CLIENT_HEARTBEAT_MS) {
+				printf("Daemon is not responding\n");
+				hung = true;
+			}
+			fflush(stdout);
+			SDL_Delay(1);
+			continue;
+		}
+		if (lost != lost_reported) {
+			printf("Client overrun: %llu events lost (%llu total)\n",
+			       (unsigned long long)(lost - lost_reported), (unsigned long long)lost);
+			lost_reported = lost;
+		}
+
+		switch (ev.type) {
+			case SDL_JOYAXISMOTION:
+				if (device < 0 || ev.jaxis.which == device)
+					printf("Joystick   %02i axis %02i value %i\n",
+					       ev.jaxis.which, ev.jaxis.axis, ev.jaxis.value);
+				break;
+			case SDL_JOYBUTTONDOWN:
+			case SDL_JOYBUTTONUP:
+				if (device < 0 || ev.jbutton.which == device)
+					printf("Joystick   %02i button %02i state %i\n",
+					       ev.jbutton.which, ev.jbutton.button, ev.jbutton.state);
+				break;
+			case SDL_JOYHATMOTION:
+				if (device < 0 || ev.jhat.which == device)
+					printf("Joystick   %02i hat %02i value %i\n",
+					       ev.jhat.which, ev.jhat.hat, ev.jhat.value);
+				break;
+			case SDL_CONTROLLERAXISMOTION:
+				if (device < 0 || ev.caxis.which == device)
+					printf("Controller %02i axis %02i value %i axis name %s\n",
+					       ev.caxis.which, ev.caxis.axis, ev.caxis.value,
+					       SDL_GameControllerGetStringForAxis((SDL_GameControllerAxis)ev.caxis.axis));
+				break;
+			case SDL_CONTROLLERBUTTONDOWN:
+			case SDL_CONTROLLERBUTTONUP:
+				if (device < 0 || ev.cbutton.which == device)
+					printf("Controller %02i button %02i state %i button name %s\n",
+					       ev.cbutton.which, ev.cbutton.button, ev.cbutton.state,
+					       SDL_GameControllerGetStringForButton((SDL_GameControllerButton)ev.cbutton.button));
+				break;
+			case SDL_JOYDEVICEADDED:
+				printf("SDL_JOYDEVICEADDED jdevice.which %02i [DEVICE INDEX]\n", ev.jdevice.which);
+				break;
+			case SDL_JOYDEVICEREMOVED:
+				printf("SDL_JOYDEVICEREMOVED jdevice.which %02i [INSTANCE ID]\n", ev.jdevice.which);
+				break;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,120 @@
+/*
+ * Shared memory event ring used by test_gamepad_SDL2 -daemon and client_gamepad_SDL2.
+ *
+ * The daemon owns all the controllers and is the only writer. Every client
+ * maps the ring read-only and keeps its own read cursor, so any number of
+ * processes can follow the event stream. A client that falls more than
+ * GAMEPAD_RING_SLOTS events behind is told how many events it lost.
+ *
+ * Clients check alive and generation to notice that the daemon exited or that
+ * a new daemon reset the ring, and heartbeat to notice a daemon that hangs.
+ * Only one daemon runs at a time, it holds a lock on GAMEPAD_RING_LOCK.
+ *
+ * Control operations (device list, subscription, rumble) go through a Unix
+ * stream socket, one text command per connection, ended by a newline:
+ *   list                          One line per device: instance gamepad haptic guid name
+ *   subscribe <instance>|all      Replies "ok <seq>", the cursor to start reading from
+ *   rumble <instance> <0-100> <ms>
+ *
+ * (c) Wintermute0110 <wintermute0110@gmail.com> 2019
+ */
+#ifndef __GAMEPAD_RING_SDL2_H
+#define __GAMEPAD_RING_SDL2_H
+
+#include <SDL2/SDL.h>
+
+#define GAMEPAD_RING_SHM_NAME "/sdljoytest_ring"
+#define GAMEPAD_RING_SOCKET   "/tmp/sdljoytest.sock"
+#define GAMEPAD_RING_LOCK     "/tmp/sdljoytest.lock"
+#define GAMEPAD_RING_MAGIC    0x534A5452 // "SJTR"
+#define GAMEPAD_RING_VERSION  2
+#define GAMEPAD_RING_SLOTS    4096       // Must be a power of two
+
+typedef struct GamepadRingSlot
+{
+	Uint64 seq;        // Sequence number of the stored event. 0 while being written.
+	SDL_Event event;
+}GamepadRingSlot;
+
+typedef struct GamepadRing
+{
+	Uint32 magic;
+	Uint32 version;
+	Uint32 slots;
+	Uint32 alive;      // 1 while the daemon runs, 0 once it exited
+	Uint64 generation; // Set by every daemon that initializes the ring
+	Uint64 heartbeat;  // Incremented by the daemon loop at least every 10 ms
+	Uint64 write_seq;  // Sequence number of the next event. The first event is 1.
+	GamepadRingSlot slot[GAMEPAD_RING_SLOTS];
+}GamepadRing;
+
+static inline void GamepadRing_Init(GamepadRing *ring, Uint64 generation)
+{
+	SDL_memset(ring, 0, sizeof(*ring));
+	ring->magic = GAMEPAD_RING_MAGIC;
+	ring->version = GAMEPAD_RING_VERSION;
+	ring->slots = GAMEPAD_RING_SLOTS;
+	__atomic_store_n(&ring->write_seq, 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&ring->generation, generation, __ATOMIC_RELAXED);
+	__atomic_store_n(&ring->alive, 1, __ATOMIC_RELEASE);
+}
+
+static inline void GamepadRing_Shutdown(GamepadRing *ring)
+{
+	__atomic_store_n(&ring->alive, 0, __ATOMIC_RELEASE);
+}
+
+// Returns 1 if the daemon that owned the ring at generation is still running.
+static inline int GamepadRing_Alive(const GamepadRing *ring, Uint64 generation)
+{
+	return __atomic_load_n(&ring->alive, __ATOMIC_ACQUIRE) &&
+	       __atomic_load_n(&ring->generation, __ATOMIC_ACQUIRE) == generation;
+}
+
+// Single writer only (the daemon).
+static inline void GamepadRing_Write(GamepadRing *ring, const SDL_Event *ev)
+{
+	Uint64 seq = __atomic_load_n(&ring->write_seq, __ATOMIC_RELAXED);
+	GamepadRingSlot *slot = &ring->slot[seq & (GAMEPAD_RING_SLOTS - 1)];
+
+	__atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	SDL_memcpy(&slot->event, ev, sizeof(*ev));
+	__atomic_store_n(&slot->seq, seq, __ATOMIC_RELEASE);
+	__atomic_store_n(&ring->write_seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+// Returns 1 and advances *cursor if an event was read, 0 if there are no new events.
+// *lost is incremented with the number of events overwritten before they could be read.
+static inline int GamepadRing_Read(const GamepadRing *ring, Uint64 *cursor, SDL_Event *ev, Uint64 *lost)
+{
+	for (;;) {
+		Uint64 write_seq = __atomic_load_n(&ring->write_seq, __ATOMIC_ACQUIRE);
+		const GamepadRingSlot *slot;
+		Uint64 seq;
+
+		if (*cursor >= write_seq)
+			return 0;
+		if (write_seq - *cursor > GAMEPAD_RING_SLOTS) {
+			// Overrun. Skip to the oldest event still in the ring.
+			*lost += write_seq - GAMEPAD_RING_SLOTS - *cursor;
+			*cursor = write_seq - GAMEPAD_RING_SLOTS;
+		}
+
+		slot = &ring->slot[*cursor & (GAMEPAD_RING_SLOTS - 1)];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		if (seq == *cursor) {
+			SDL_memcpy(ev, &slot->event, sizeof(*ev));
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == *cursor) {
+				(*cursor)++;
+				return 1;
+			}
+		}
+		// The writer lapped us and is reusing this slot. The event is lost.
+		(*lost)++;
+		(*cursor)++;
+	}
+}
+
+#endif
@@ -3,24 +3,26 @@
  * Inspired by SDL2 example controllermap.c by Sam Lantinga <slouken@libsdl.org>
  * 
  * (c) Wintermute0110 <wintermute0110@gmail.com> 2014-2018
+ *
+ * Options:
+ *  -record FILE             Record the events received to FILE
+ *  -replay FILE             Replay FILE instead of reading the joystick
+ *  -replay_speed X          Replay X times faster than recorded, 0 = as fast as possible (default)
  */
 #include <SDL2/SDL.h>
+#include "replay_SDL2.h"
+#include "mapping_SDL2.h"
 
 // IMPORTANT: SDL gets only keyboard events from a Window it has created. This
 // means no keyboad events can be usde in thi application.
 
 // #define __DEBUG_SDL_EVENTS
 
-#define MARKER_BUTTON 1
-#define MARKER_AXIS 2
-
-typedef struct MappingStep
-{
-	int marker;
-	char field[256];
-	int axis, button, hat, hat_value;
-	char mapping[4096];
-}MappingStep;
+// Wizard controls from the gamepad itself, once "a" and "b" are mapped.
+// Holding a button is needed so a normal press is not taken as a command.
+#define STEP_A 1
+#define STEP_B 2
+#define CONTROL_HOLD_MS 1000
 
 SDL_Joystick *joy = NULL;
 SDL_JoystickID instanceID = -1; // Joystick instance ID. Changes if there are hotplug events!!!
@@ -29,6 +31,12 @@ int SDL_joystick_is_gamepad = 0; // True if joystick is a SDL2 recognised gamepa
 
 int SDL_dead_zone = 10000;
 
+// Record/replay. Replay runs on event time, see replay_SDL2.h.
+Replay replay;
+FILE *record_file = NULL;
+
+SDL_TimerID my_timer_id = 0;
+Uint32 timeout_deadline = 0; // Step timeout on the simulated clock when replaying
 void* my_callback_param = NULL;
 Uint32 my_callbackfunc(Uint32 interval, void *param)
 {
@@ -53,39 +61,73 @@ Uint32 my_callbackfunc(Uint32 interval, void *param)
     return 0;
 }
 
+// Start the step timeout and cancel the previous one. When replaying, the
+// timeout is a deadline on the simulated clock instead of an SDL timer.
+void Mapping_Start_Timeout(Uint32 delay)
+{
+	if (replay.file) {
+		timeout_deadline = Replay_Ticks(&replay) + delay;
+		return;
+	}
+	SDL_RemoveTimer(my_timer_id);
+	my_timer_id = SDL_AddTimer(delay, my_callbackfunc, my_callback_param);
+}
+
+// Stop the step timeout, while a control button is held.
+void Mapping_Stop_Timeout(void)
+{
+	if (replay.file) {
+		timeout_deadline = 0;
+		return;
+	}
+	SDL_RemoveTimer(my_timer_id);
+	my_timer_id = 0;
+}
+
+// Undo the last mapped step. The undo log is the mapping_offset of each step:
+// the mapping string is cut back to the length it had before that step.
+// Returns the step to map next.
+int Mapping_Undo(MappingStep *steps, int s, char *mapping)
+{
+	if (s == 0)
+		return 0;
+	s--;
+	mapping[steps[s].mapping_offset] = '\0';
+	steps[s].axis = -1;
+	steps[s].button = -1;
+	steps[s].hat = -1;
+	steps[s].hat_value = -1;
+
+	return s;
+}
+
 int main(int argn, char** argv)
 {
 	int numJoysticks, i;
 	SDL_version compiled;
 	SDL_version linked;
 	SDL_Event ev;
+	const char *record_path = NULL;
+	const char *replay_path = NULL;
+	float replay_speed = 0;
 	
 	const char *name = NULL;
 	MappingStep *step;
-	MappingStep steps[] = {
-		{MARKER_BUTTON, "x", -1, -1, -1, -1, ""},
-		{MARKER_BUTTON, "a", -1, -1, -1, -1, ""},
-		{MARKER_BUTTON, "b", -1, -1, -1, -1, ""},
-		{MARKER_BUTTON, "y", -1, -1, -1, -1, ""},
-		{MARKER_BUTTON, "back", -1, -1, -1, -1, ""},
-		{MARKER_BUTTON, "guide", -1, -1, -1, -1, ""},
-		{MARKER_BUTTON, "start", -1, -1, -1, -1, ""},        
-		{MARKER_BUTTON, "dpleft", -1, -1, -1, -1, ""},
-		{MARKER_BUTTON, "dpdown", -1, -1, -1, -1, ""},
-		{MARKER_BUTTON, "dpright", -1, -1, -1, -1, ""},
-		{MARKER_BUTTON, "dpup", -1, -1, -1, -1, ""},
-		{MARKER_BUTTON, "leftshoulder", -1, -1, -1, -1, ""},
-		{MARKER_BUTTON, "lefttrigger", -1, -1, -1, -1, ""},
-		{MARKER_BUTTON, "rightshoulder", -1, -1, -1, -1, ""},
-		{MARKER_BUTTON, "righttrigger", -1, -1, -1, -1, ""},
-		{MARKER_BUTTON, "leftstick", -1, -1, -1, -1, ""},
-		{MARKER_BUTTON, "rightstick", -1, -1, -1, -1, ""},
-		{MARKER_AXIS, "leftx", -1, -1, -1, -1, ""},
-		{MARKER_AXIS, "lefty", -1, -1, -1, -1, ""},        
-		{MARKER_AXIS, "rightx", -1, -1, -1, -1, ""},
-		{MARKER_AXIS, "righty", -1, -1, -1, -1, ""},
-	};
+	MappingStep steps[MAPPING_NUM_STEPS];
 		
+	for (i = 1; i < argn; i++) {
+		if (strcmp(argv[i], "-record") == 0 && i + 1 < argn) {
+			record_path = argv[++i];
+		} else if (strcmp(argv[i], "-replay") == 0 && i + 1 < argn) {
+			replay_path = argv[++i];
+		} else if (strcmp(argv[i], "-replay_speed") == 0 && i + 1 < argn) {
+			replay_speed = SDL_atof(argv[++i]);
+		} else {
+			printf("Unknown option '%s'\n", argv[i]);
+			return 1;
+		}
+	}
+
 	SDL_VERSION(&compiled);
 	printf("Sys_InitInput: Compiled with SDL version %d.%d.%d\n", compiled.major, compiled.minor, compiled.patch);
 	SDL_GetVersion(&linked);
@@ -94,12 +136,32 @@ int main(int argn, char** argv)
 	//
 	// Joystick initialisation
 	//
-	printf( "Sys_InitInput: Joystick subsystem init\n" );
-	if( SDL_Init( SDL_INIT_JOYSTICK | SDL_INIT_GAMECONTROLLER | SDL_INIT_HAPTIC ) )
+	// When replaying the recorded joystick is not present, only events are needed.
+	//
+	if( replay_path )
 	{
-		printf( "Sys_InitInput: SDL_Init() failed: %s\n", SDL_GetError());
-		
-		return 0;
+		if( Replay_Open( &replay, replay_path, replay_speed ) != 0 )
+		{
+			printf( "Sys_InitInput: cannot replay %s\n", replay_path );
+			
+			return 1;
+		}
+		if( SDL_Init( SDL_INIT_EVENTS ) )
+		{
+			printf( "Sys_InitInput: SDL_Init() failed: %s\n", SDL_GetError());
+			
+			return 0;
+		}
+	}
+	else
+	{
+		printf( "Sys_InitInput: Joystick subsystem init\n" );
+		if( SDL_Init( SDL_INIT_JOYSTICK | SDL_INIT_GAMECONTROLLER | SDL_INIT_HAPTIC ) )
+		{
+			printf( "Sys_InitInput: SDL_Init() failed: %s\n", SDL_GetError());
+			
+			return 0;
+		}
 	}
 	
 	//
@@ -115,7 +177,7 @@ int main(int argn, char** argv)
 	//
 	// Print joystick information
 	//
-	numJoysticks = SDL_NumJoysticks();
+	numJoysticks = replay.file ? 0 : SDL_NumJoysticks();
 	printf( "Sys_InitInput: Joystick subsytem - Found %i joysticks at startup\n", numJoysticks );
 	printf("Joysticks present at startup\n");
 	for( i = 0; i < numJoysticks; i++ ) {
@@ -145,7 +207,13 @@ int main(int argn, char** argv)
 	//
 	int gamepad_idx_to_open = 0;
 	
-	if( numJoysticks > 0 )
+	if( replay.file )
+	{
+		name = replay.header.name;
+		printf( "Replaying %s recorded with joystick (%s)\n", replay_path, name );
+		printf( "        guid: %s\n", replay.header.guid );
+	}
+	else if( numJoysticks > 0 )
 	{
 		joy = SDL_JoystickOpen( gamepad_idx_to_open );
 		if (joy == NULL ) {
@@ -183,17 +251,23 @@ int main(int argn, char** argv)
 	int s, _s;
 	SDL_bool done = SDL_FALSE, next=SDL_FALSE;
 	Uint32 delay = (3000 / 10) * 10;  /* To round it down to the nearest 10 ms */
-	SDL_TimerID my_timer_id = 0;
+	int hold_button = -1;  // Control button being held, -1 if none
+	Uint32 hold_start = 0;
 
 	printf("\
 ====================================================================================\n\
 * Press the buttons/axes on your controller when indicated\n\
-* To skip a button wait 3 seconds for a timeout\n\
+* To skip a button wait 3 seconds for a timeout or hold A for 1 second\n\
+* To undo the last button/axis hold B for 1 second\n\
 * To exit cancelling everything, press CTRL+C\n\
 ====================================================================================\n");
 	
 	/* Initialize mapping with GUID and name */
-	SDL_JoystickGetGUIDString(SDL_JoystickGetGUID(joy), temp, SDL_arraysize(temp));
+	SDL_memcpy(steps, mapping_steps, sizeof(steps));
+	if (replay.file)
+		SDL_strlcpy(temp, replay.header.guid, SDL_arraysize(temp));
+	else
+		SDL_JoystickGetGUIDString(SDL_JoystickGetGUID(joy), temp, SDL_arraysize(temp));
 	SDL_snprintf(mapping, SDL_arraysize(mapping), "%s,%s,platform:%s,",
 			temp, name ? name : "Unknown Joystick", SDL_GetPlatform());
 
@@ -201,13 +275,18 @@ int main(int argn, char** argv)
 	// My Logitech F710 produces a couple of random axis events at startup...
 	while(SDL_PollEvent(&ev)) {};
 	
+	if (record_path) {
+		record_file = Replay_Record_Open(record_path, temp, name);
+		if (!record_file)
+			printf("Cannot record to %s\n", record_path);
+	}
 	
 	/* Loop, getting joystick events! */
 	for(s = 0; s < SDL_arraysize(steps) && !done;) 
 	{
 		/* Print button/axis to map */
 		step = &steps[s];
-		SDL_strlcpy(step->mapping, mapping, SDL_arraysize(step->mapping));
+		step->mapping_offset = SDL_strlen(mapping);
 		step->axis = -1;
 		step->button = -1;
 		step->hat = -1;
@@ -217,15 +296,21 @@ int main(int argn, char** argv)
 		fflush(stdout);
 		
 		// Start timeout timer, and cancel previous timeout.
-		SDL_RemoveTimer(my_timer_id);
-		my_timer_id = SDL_AddTimer(delay, my_callbackfunc, my_callback_param);
+		// A hold started in the previous step does not carry over.
+		Mapping_Start_Timeout(delay);
+		hold_button = -1;
 	
 		next = SDL_FALSE;
 		while (!done && !next) 
 		{
 			// SDL_PollEvent / SDL_WaitEvent
-			if(SDL_WaitEvent(&ev) ) 
+			// Replay_Wait_Event() also generates the timeout SDL_USEREVENT
+			if(replay.file ? Replay_Wait_Event(&replay, &ev, timeout_deadline, SDL_USEREVENT) : SDL_WaitEvent(&ev)) 
 			{
+				// Timeouts are not recorded, replay generates them
+				if (record_file && ev.type != SDL_USEREVENT)
+					Replay_Record_Event(record_file, &ev);
+
 				switch (ev.type) 
 				{
 					case SDL_JOYAXISMOTION:
@@ -238,9 +323,7 @@ int main(int argn, char** argv)
 							}
 							if (_s == s) {
 								step->axis = ev.jaxis.axis;
-								SDL_strlcat(mapping, step->field, SDL_arraysize(mapping));
-								SDL_snprintf(temp, SDL_arraysize(temp), ":a%u,", ev.jaxis.axis);
-								SDL_strlcat(mapping, temp, SDL_arraysize(mapping));
+								Mapping_Append(mapping, SDL_arraysize(mapping), step);
 								s++;
 								next = SDL_TRUE;
 							}
@@ -276,9 +359,7 @@ int main(int argn, char** argv)
 						if (_s == s) {
 							step->hat = ev.jhat.hat;
 							step->hat_value = ev.jhat.value;
-							SDL_strlcat(mapping, step->field, SDL_arraysize(mapping));
-							SDL_snprintf(temp, SDL_arraysize(temp), ":h%u.%u,", ev.jhat.hat, ev.jhat.value );
-							SDL_strlcat(mapping, temp, SDL_arraysize(mapping));
+							Mapping_Append(mapping, SDL_arraysize(mapping), step);
 							s++;
 							next = SDL_TRUE;
 						}
@@ -288,7 +369,23 @@ int main(int argn, char** argv)
 						break;
 						
 					case SDL_JOYBUTTONUP:
-						// Ignore this event
+						// Gamepad controls act when a held control button is released
+						if (ev.jbutton.button != hold_button)
+							break;
+						hold_button = -1;
+						// Event timestamps, so replays see the same hold times
+						if (ev.jbutton.timestamp - hold_start < CONTROL_HOLD_MS) {
+							Mapping_Start_Timeout(delay);
+							break;
+						}
+						if (ev.jbutton.button == steps[STEP_B].button) {
+							printf("Undoing last button/axis. (B held)\n");
+							s = Mapping_Undo(steps, s, mapping);
+						} else {
+							printf("Skipping button/axis. (A held)\n");
+							s++;
+						}
+						next = SDL_TRUE;
 						break;
 						
 					case SDL_JOYBUTTONDOWN:
@@ -298,17 +395,26 @@ int main(int argn, char** argv)
 								break;
 							}
 						}
+						if (_s < s && (_s == STEP_A || _s == STEP_B)) {
+							// Mapped A or B pressed. It is a command if held long enough.
+							// Stop the timeout so the step is not skipped meanwhile,
+							// it is restarted if the button is released too soon.
+							hold_button = ev.jbutton.button;
+							hold_start = ev.jbutton.timestamp;
+							Mapping_Stop_Timeout();
+						}
 						if (_s == s) {
 							step->button = ev.jbutton.button;
-							SDL_strlcat(mapping, step->field, SDL_arraysize(mapping));
-							SDL_snprintf(temp, SDL_arraysize(temp), ":b%u,", ev.jbutton.button);
-							SDL_strlcat(mapping, temp, SDL_arraysize(mapping));
+							Mapping_Append(mapping, SDL_arraysize(mapping), step);
 							s++;
 							next=SDL_TRUE;
 						}
 						break;
 
 					case SDL_USEREVENT:
+						// Timeout queued before a control button was pressed
+						if (hold_button >= 0)
+							break;
 						// Timeout. The gamepad has not this button/axis
 #ifdef __DEBUG_SDL_EVENTS
 						printf("Skipping button/axis (timeout)\n");
@@ -328,8 +434,7 @@ int main(int argn, char** argv)
 							/* Undo! */
 							if (s > 0) {
 								printf("Undoing last button/axis. (SDLK_BACKSPACE / SDLK_AC_BACK)\n");
-								SDL_strlcpy(mapping, step->mapping, SDL_arraysize(step->mapping));
-								s--;
+								s = Mapping_Undo(steps, s, mapping);
 								next = SDL_TRUE;
 							}
 							break;
@@ -378,6 +483,12 @@ int main(int argn, char** argv)
 	// Flush events
 	while(SDL_PollEvent(&ev)) {};
 	
+	if (record_file) {
+		fclose(record_file);
+		record_file = NULL;
+	}
+	Replay_Close(&replay);
+	
 	//
 	// Close joystick
 	//
@@ -0,0 +1,67 @@
+/*
+ * Mapping string assembly shared by map_gamepad_SDL2 and bench_gamepad_SDL2.
+ * A mapping is "guid,name,platform:X," followed by one field:binding pair per
+ * mapped step, the binding being b<button>, a<axis> or h<hat>.<value>.
+ *
+ * (c) Wintermute0110 <wintermute0110@gmail.com> 2019
+ */
+#ifndef __MAPPING_SDL2_H
+#define __MAPPING_SDL2_H
+
+#include <SDL2/SDL.h>
+
+#define MARKER_BUTTON 1
+#define MARKER_AXIS 2
+
+typedef struct MappingStep
+{
+	int marker;
+	const char *field;
+	int axis, button, hat, hat_value;
+	int mapping_offset; // Length of the mapping string before this step. Used to undo.
+}MappingStep;
+
+// Steps in the order the user is asked for them. Copied before use.
+static const MappingStep mapping_steps[] = {
+	{MARKER_BUTTON, "x", -1, -1, -1, -1, 0},
+	{MARKER_BUTTON, "a", -1, -1, -1, -1, 0},
+	{MARKER_BUTTON, "b", -1, -1, -1, -1, 0},
+	{MARKER_BUTTON, "y", -1, -1, -1, -1, 0},
+	{MARKER_BUTTON, "back", -1, -1, -1, -1, 0},
+	{MARKER_BUTTON, "guide", -1, -1, -1, -1, 0},
+	{MARKER_BUTTON, "start", -1, -1, -1, -1, 0},
+	{MARKER_BUTTON, "dpleft", -1, -1, -1, -1, 0},
+	{MARKER_BUTTON, "dpdown", -1, -1, -1, -1, 0},
+	{MARKER_BUTTON, "dpright", -1, -1, -1, -1, 0},
+	{MARKER_BUTTON, "dpup", -1, -1, -1, -1, 0},
+	{MARKER_BUTTON, "leftshoulder", -1, -1, -1, -1, 0},
+	{MARKER_BUTTON, "lefttrigger", -1, -1, -1, -1, 0},
+	{MARKER_BUTTON, "rightshoulder", -1, -1, -1, -1, 0},
+	{MARKER_BUTTON, "righttrigger", -1, -1, -1, -1, 0},
+	{MARKER_BUTTON, "leftstick", -1, -1, -1, -1, 0},
+	{MARKER_BUTTON, "rightstick", -1, -1, -1, -1, 0},
+	{MARKER_AXIS, "leftx", -1, -1, -1, -1, 0},
+	{MARKER_AXIS, "lefty", -1, -1, -1, -1, 0},
+	{MARKER_AXIS, "rightx", -1, -1, -1, -1, 0},
+	{MARKER_AXIS, "righty", -1, -1, -1, -1, 0},
+};
+
+#define MAPPING_NUM_STEPS ((int)SDL_arraysize(mapping_steps))
+
+// Append the binding of a mapped step. Exactly one of axis, button and hat
+// is not -1, as stored in the step.
+static inline void Mapping_Append(char *mapping, size_t size, const MappingStep *step)
+{
+	char temp[32];
+
+	SDL_strlcat(mapping, step->field, size);
+	if (step->axis >= 0)
+		SDL_snprintf(temp, sizeof(temp), ":a%u,", step->axis);
+	else if (step->button >= 0)
+		SDL_snprintf(temp, sizeof(temp), ":b%u,", step->button);
+	else
+		SDL_snprintf(temp, sizeof(temp), ":h%u.%u,", step->hat, step->hat_value);
+	SDL_strlcat(mapping, temp, size);
+}
+
+#endif
@@ -0,0 +1,144 @@
+/*
+ * Event recording and replay for test_gamepad_SDL2 and map_gamepad_SDL2.
+ *
+ * A recording is a header (GUID and name of the device in use) followed by the
+ * raw SDL_Event structures, each one with its SDL_GetTicks() timestamp.
+ * During replay the clock is simulated: Replay_Ticks() is the timestamp of the
+ * last replayed event and timeouts fire on event time, not on wall time. Speed 0
+ * replays as fast as possible and the output only depends on the recording.
+ *
+ * (c) Wintermute0110 <wintermute0110@gmail.com> 2019
+ */
+#ifndef __REPLAY_SDL2_H
+#define __REPLAY_SDL2_H
+
+#include <SDL2/SDL.h>
+
+#define REPLAY_MAGIC "SJTREC01"
+
+typedef struct ReplayHeader
+{
+	char magic[8];
+	Uint32 event_size;  // sizeof(SDL_Event) of the recording program
+	Uint32 start_ticks; // SDL_GetTicks() when the recording started
+	char guid[64];
+	char name[128];
+}ReplayHeader;
+
+typedef struct Replay
+{
+	FILE *file;         // NULL if not replaying
+	ReplayHeader header;
+	float speed;        // 0 means as fast as possible
+	Uint32 now;         // Simulated SDL_GetTicks()
+	Uint32 first;       // Timestamp of the first event
+	Uint64 wall_start;  // Performance counter when the first event was replayed
+	SDL_Event next;     // Read ahead event
+	int has_next;
+}Replay;
+
+static inline FILE *Replay_Record_Open(const char *path, const char *guid, const char *name)
+{
+	ReplayHeader header;
+	FILE *f = fopen(path, "wb");
+
+	if (!f)
+		return NULL;
+	SDL_memset(&header, 0, sizeof(header));
+	SDL_memcpy(header.magic, REPLAY_MAGIC, sizeof(header.magic));
+	header.event_size = sizeof(SDL_Event);
+	header.start_ticks = SDL_GetTicks();
+	SDL_strlcpy(header.guid, guid ? guid : "", sizeof(header.guid));
+	SDL_strlcpy(header.name, name ? name : "", sizeof(header.name));
+	fwrite(&header, sizeof(header), 1, f);
+
+	return f;
+}
+
+static inline void Replay_Record_Event(FILE *f, const SDL_Event *ev)
+{
+	fwrite(ev, sizeof(*ev), 1, f);
+}
+
+// Returns 0 on success.
+static inline int Replay_Open(Replay *r, const char *path, float speed)
+{
+	SDL_memset(r, 0, sizeof(*r));
+	r->file = fopen(path, "rb");
+	if (!r->file)
+		return -1;
+	if (fread(&r->header, sizeof(r->header), 1, r->file) != 1 ||
+	    SDL_memcmp(r->header.magic, REPLAY_MAGIC, sizeof(r->header.magic)) != 0 ||
+	    r->header.event_size != sizeof(SDL_Event)) {
+		fclose(r->file);
+		r->file = NULL;
+		return -1;
+	}
+	r->speed = speed;
+	r->now = r->header.start_ticks;
+
+	return 0;
+}
+
+static inline void Replay_Close(Replay *r)
+{
+	if (r->file)
+		fclose(r->file);
+	r->file = NULL;
+}
+
+// SDL_GetTicks() replacement, simulated while replaying.
+static inline Uint32 Replay_Ticks(const Replay *r)
+{
+	return r->file ? r->now : SDL_GetTicks();
+}
+
+// Advance the simulated clock. With a speed set, wait until the wall clock
+// catches up so the replay runs speed times faster than the recording.
+static inline void Replay_Advance(Replay *r, Uint32 ticks)
+{
+	if (!r->wall_start) {
+		r->wall_start = SDL_GetPerformanceCounter();
+		r->first = ticks;
+	}
+	r->now = ticks;
+	if (r->speed > 0) {
+		double due = (ticks - r->first) / r->speed / 1000.0;
+		double elapsed = (double)(SDL_GetPerformanceCounter() - r->wall_start) / SDL_GetPerformanceFrequency();
+
+		if (due > elapsed)
+			SDL_Delay((Uint32)((due - elapsed) * 1000.0));
+	}
+}
+
+// SDL_WaitEvent() replacement. If deadline is not 0 and the next recorded
+// event comes after it, an event of type timeout_type is returned at the
+// deadline instead, like an SDL_AddTimer() callback would push it.
+// At the end of the recording an SDL_QUIT event is returned.
+static inline int Replay_Wait_Event(Replay *r, SDL_Event *ev, Uint32 deadline, Uint32 timeout_type)
+{
+	if (!r->has_next)
+		r->has_next = fread(&r->next, sizeof(r->next), 1, r->file) == 1;
+
+	if (deadline && (!r->has_next || r->next.common.timestamp >= deadline)) {
+		Replay_Advance(r, deadline);
+		SDL_memset(ev, 0, sizeof(*ev));
+		ev->type = timeout_type;
+		ev->common.timestamp = deadline;
+		return 1;
+	}
+	if (!r->has_next) {
+		SDL_memset(ev, 0, sizeof(*ev));
+		ev->type = SDL_QUIT;
+		ev->common.timestamp = r->now;
+		return 1;
+	}
+
+	*ev = r->next;
+	r->has_next = 0;
+	Replay_Advance(r, ev->common.timestamp);
+
+	return 1;
+}
+
+#endif
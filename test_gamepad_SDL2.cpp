@@ -3,70 +3,2381 @@
  * Also tests new SDL2 features: game controller, joystick/gamepad, hotplug and haptics/rumble.
  * 
  * (c) Wintermute0110 <wintermute0110@gmail.com> December 2014
+ *
+ * Options:
+ *  -skip_loop               Print joystick information and exit
+ *  -loop wait|poll|hybrid   Event loop mode (default wait)
+ *  -hybrid_busy_ms N        Hybrid loop: busy-poll N ms after the last event
+ *  -hybrid_backoff_ms N     Hybrid loop: spin/yield/sleep N ms before blocking
+ *  -hybrid_wait_ms N        Hybrid loop: blocking wait timeout when idle
+ *  -daemon                  Own all controllers and serve events to client_gamepad_SDL2
+ *  -sensors                 Stream gamepad gyro/accelerometer data
+ *  -sensor_synthetic HZ     Feed the sensor mode with synthetic samples at HZ (headless testing)
+ *  -queue_stats             Sample SDL event queue depth and account lost events per device
+ *  -queue_flood N           Push N sequence numbered events from a thread and detect gaps
+ *  -event_filter            Handle joystick events in an SDL event filter, before the queue
+ *  -curve C                 Stick response curve: linear, expo[:E], scurve[:K] or
+ *                           spline:x=y,x=y,... (up to 6 points in 0..1)
+ *  -trigger_curve C         Trigger response curve, same syntax as -curve
+ *  -curve_bench             Benchmark lookup tables against direct curve evaluation and exit
+ *  -device_cache FILE       Load the per-GUID device cache from FILE and save it at exit
+ *  -record FILE             Record the events received to FILE
+ *  -replay FILE             Replay FILE instead of reading the devices
+ *  -replay_speed X          Replay X times faster than recorded, 0 = as fast as possible (default)
+ *  -output text|jsonl|csv|binary
+ *                           Input event output format (default text). Structured formats
+ *                           go to stdout and every other message goes to stderr.
  */
 #include <SDL2/SDL.h>
+#include <time.h>
+#include <charconv>
+#if defined(__unix__)
+#include <unistd.h>
+#endif
+#include "replay_SDL2.h"
+#include "test_gamepad_SDL2.h"
+
+// This must be enabled by default. We are in 2019, many gamepads are wireless.
+#define __SDL2_ENABLE_CONTROLLER_HOTPLUG
+
+// Daemon mode uses POSIX shared memory and Unix sockets.
+#if defined(__unix__)
+#define __SDL2_ENABLE_DAEMON
+#endif
+
+// Game controller sensors were added in SDL 2.0.14
+#if SDL_VERSION_ATLEAST(2, 0, 14)
+#define __SDL2_ENABLE_SENSORS
+#endif
+
+#ifdef __SDL2_ENABLE_DAEMON
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "gamepad_ring_SDL2.h"
+#endif
+
+SDL_Joystick *joy = NULL;
+// Game controllers do not have hats or balls, only joysticks have.
+int SDL_joystick_has_hat = 0;
+
+SDL_GameController *gamepad = NULL;
+SDL_JoystickID instanceID = -1; // Joystick instance ID. Changes if there are hotplug events!!!
+int device_index_in_use = -1; // This is the devic number in use
+const int SDL_wanted_joystick_number = 0; // Joystick device index user wants to use
+SDL_Haptic *haptic = NULL;
+
+int SDL_joystick_is_gamepad = 0; // True if joystick is a SDL2 recognised gamepad
+
+int SDL_dead_zone = 1000;
+
+// Record/replay. Replay runs on event time, see replay_SDL2.h.
+Replay replay;
+FILE *record_file = NULL;
+
+//
+// Event loop scheduling.
+// SDL_PollEvent() has the lowest latency but burns 100% CPU. SDL_WaitEvent()
+// is cheap but only wakes up when SDL pumps the joystick devices.
+// The hybrid loop busy-polls for a short window after the last event (active
+// play), then backs off spinning, yielding and sleeping, and finally falls back
+// to blocking waits when the gamepad is idle (menus).
+//
+#define LOOP_MODE_WAIT   0
+#define LOOP_MODE_POLL   1
+#define LOOP_MODE_HYBRID 2
+
+#define LOOP_PHASE_BUSY    0
+#define LOOP_PHASE_BACKOFF 1
+#define LOOP_PHASE_IDLE    2
+#define LOOP_PHASE_MAX     3
+
+// Backoff: number of empty polls spent spinning, then yielding, then sleeping 1 ms.
+#define HYBRID_SPIN_POLLS  64
+#define HYBRID_YIELD_POLLS 64
+#define HYBRID_SPIN_COUNT  256
+
+int SDL_loop_mode = LOOP_MODE_WAIT;
+Uint32 SDL_hybrid_busy_ms = 250;
+Uint32 SDL_hybrid_backoff_ms = 2000;
+Uint32 SDL_hybrid_wait_ms = 100;
+
+typedef struct LoopPhaseStats
+{
+	const char *name;
+	Uint32 events;
+	Uint64 queue_sum_ms;    // Queue residency, event timestamp to dequeue
+	Uint32 queue_max_ms;
+	Uint64 checks;          // Number of SDL_PollEvent()/SDL_WaitEvent() calls
+	Uint64 gaps;
+	Uint64 gap_sum;         // Time between checks (performance counter ticks)
+	Uint64 gap_max;
+	Uint64 wall;            // Time spent in this phase (performance counter ticks)
+	clock_t cpu;            // CPU time spent in this phase
+}LoopPhaseStats;
+
+LoopPhaseStats SDL_loop_stats[LOOP_PHASE_MAX] = {
+	{"busy"}, {"backoff"}, {"idle"},
+};
+int SDL_loop_phase = LOOP_PHASE_IDLE;
+Uint32 SDL_loop_last_event_ticks = 0;
+Uint64 SDL_loop_last_check = 0;
+Uint64 SDL_loop_phase_start = 0;
+clock_t SDL_loop_phase_start_cpu = 0;
+
+void SDL2_Loop_Set_Phase(int phase)
+{
+	Uint64 now = SDL_GetPerformanceCounter();
+	clock_t cpu = clock();
+
+	if (SDL_loop_phase_start) {
+		SDL_loop_stats[SDL_loop_phase].wall += now - SDL_loop_phase_start;
+		SDL_loop_stats[SDL_loop_phase].cpu += cpu - SDL_loop_phase_start_cpu;
+	}
+	SDL_loop_phase = phase;
+	SDL_loop_phase_start = now;
+	SDL_loop_phase_start_cpu = cpu;
+}
+
+// Account the time since the previous check against the current phase.
+// Polls pump the devices, so the gap between two polls is the input latency
+// estimate: an input waits up to one gap before SDL sees it. Blocking waits
+// pump internally and the time around them is the user's idle time, so no
+// gap is measured across a blocking check.
+void SDL2_Loop_Check(int blocking)
+{
+	Uint64 now = SDL_GetPerformanceCounter();
+	LoopPhaseStats *st = &SDL_loop_stats[SDL_loop_phase];
+
+	st->checks++;
+	if (blocking) {
+		SDL_loop_last_check = 0;
+		return;
+	}
+	if (SDL_loop_last_check) {
+		Uint64 gap = now - SDL_loop_last_check;
+
+		st->gaps++;
+		st->gap_sum += gap;
+		if (gap > st->gap_max)
+			st->gap_max = gap;
+	}
+	SDL_loop_last_check = now;
+}
+
+// Returns 1 when an event is stored in ev, 0 on error.
+int SDL2_Loop_Get_Event(SDL_Event *ev)
+{
+	int got = 0;
+	Uint32 misses = 0;
+	int j;
+
+	while (!got) {
+		if (SDL_loop_mode == LOOP_MODE_WAIT) {
+			if (SDL_loop_phase != LOOP_PHASE_IDLE)
+				SDL2_Loop_Set_Phase(LOOP_PHASE_IDLE);
+			SDL2_Loop_Check(1);
+			got = SDL_WaitEvent(ev);
+			if (!got)
+				return 0;
+		} else if (SDL_loop_mode == LOOP_MODE_POLL) {
+			if (SDL_loop_phase != LOOP_PHASE_BUSY)
+				SDL2_Loop_Set_Phase(LOOP_PHASE_BUSY);
+			SDL2_Loop_Check(0);
+			got = SDL_PollEvent(ev);
+		} else {
+			Uint32 idle_ms = SDL_GetTicks() - SDL_loop_last_event_ticks;
+
+			if (idle_ms < SDL_hybrid_busy_ms) {
+				if (SDL_loop_phase != LOOP_PHASE_BUSY)
+					SDL2_Loop_Set_Phase(LOOP_PHASE_BUSY);
+				SDL2_Loop_Check(0);
+				got = SDL_PollEvent(ev);
+			} else if (idle_ms < SDL_hybrid_busy_ms + SDL_hybrid_backoff_ms) {
+				if (SDL_loop_phase != LOOP_PHASE_BACKOFF) {
+					SDL2_Loop_Set_Phase(LOOP_PHASE_BACKOFF);
+					misses = 0;
+				}
+				SDL2_Loop_Check(0);
+				got = SDL_PollEvent(ev);
+				if (!got) {
+					if (misses < HYBRID_SPIN_POLLS) {
+						for (j = 0; j < HYBRID_SPIN_COUNT; j++)
+							SDL_CompilerBarrier();
+					} else if (misses < HYBRID_SPIN_POLLS + HYBRID_YIELD_POLLS) {
+						SDL_Delay(0);
+					} else {
+						SDL_Delay(1);
+					}
+					misses++;
+				}
+			} else {
+				if (SDL_loop_phase != LOOP_PHASE_IDLE)
+					SDL2_Loop_Set_Phase(LOOP_PHASE_IDLE);
+				SDL2_Loop_Check(1);
+				got = SDL_WaitEventTimeout(ev, SDL_hybrid_wait_ms);
+			}
+		}
+	}
+
+	// Events are timestamped with SDL_GetTicks() when SDL queues them, in the
+	// pump done by the check itself. This is the time spent in the queue, not
+	// the input latency (see SDL2_Loop_Check()).
+	LoopPhaseStats *st = &SDL_loop_stats[SDL_loop_phase];
+	Uint32 now = SDL_GetTicks();
+	Uint32 queued = now > ev->common.timestamp ? now - ev->common.timestamp : 0;
+
+	st->events++;
+	st->queue_sum_ms += queued;
+	if (queued > st->queue_max_ms)
+		st->queue_max_ms = queued;
+	SDL_loop_last_event_ticks = now;
+
+	return 1;
+}
+
+void SDL2_Loop_Report(void)
+{
+	const char *mode_names[] = {"wait", "poll", "hybrid"};
+	double freq = (double)SDL_GetPerformanceFrequency();
+	int p;
+
+	// Close the current phase so its time is accounted
+	SDL2_Loop_Set_Phase(SDL_loop_phase);
+
+	printf("Event loop mode %s", mode_names[SDL_loop_mode]);
+	if (SDL_loop_mode == LOOP_MODE_HYBRID)
+		printf(" (busy %u ms / backoff %u ms / wait %u ms)",
+		       SDL_hybrid_busy_ms, SDL_hybrid_backoff_ms, SDL_hybrid_wait_ms);
+	printf("\n");
+	printf(" Input latency is estimated by the gap between polls, n/a when blocking.\n"
+	       " Queue is the time from the pump to the dequeue.\n");
+	printf(" Phase     Events  Avg queue ms  Max queue ms      Checks  Avg gap us  Max gap us    Wall s   CPU %%\n");
+	for (p = 0; p < LOOP_PHASE_MAX; p++) {
+		LoopPhaseStats *st = &SDL_loop_stats[p];
+		double wall_s = st->wall / freq;
+		double cpu_s = (double)st->cpu / CLOCKS_PER_SEC;
+
+		printf(" %-8s %7u  %12.2f  %12u  %10llu",
+		       st->name, st->events,
+		       st->events ? (double)st->queue_sum_ms / st->events : 0.0,
+		       st->queue_max_ms, (unsigned long long)st->checks);
+		// The idle phase only blocks, it has no gaps
+		if (st->gaps)
+			printf("  %10.1f  %10.0f", st->gap_sum * 1000000.0 / freq / st->gaps,
+			       st->gap_max * 1000000.0 / freq);
+		else
+			printf("  %10s  %10s", "n/a", "n/a");
+		printf("  %8.2f  %6.1f\n", wall_s, wall_s > 0 ? 100.0 * cpu_s / wall_s : 0.0);
+	}
+}
+
+//
+// Device cache.
+// Opening a device probes the GUID string, the capability counts, the mapping
+// and the haptic rumble support. Devices are cached by GUID the first time
+// they are opened (cold open). When a known device is reconnected (warm open),
+// all of this comes from the cache. Cached mappings are probed again after
+// the mapping DB is loaded or a controller is remapped. The cache also keeps
+// the axis ranges seen while the device was in use. With -device_cache it is saved to disk, so
+// devices are known from previous sessions.
+//
+#define DEVICE_CACHE_MAGIC "SJTDEV01"
+#define DEVICE_CACHE_MAX   32
+#define DEVICE_CACHE_AXES  16
+
+#define DEVICE_HAPTIC_UNKNOWN 0
+#define DEVICE_HAPTIC_NONE    1 // Not haptic or rumble not supported
+#define DEVICE_HAPTIC_RUMBLE  2
+
+#define DEVICE_MAPPING_STALE  -1 // is_gamepad of entries whose mapping must be probed again
+
+typedef struct DeviceCacheEntry
+{
+	SDL_JoystickGUID guid;
+	char guid_string[64];
+	char name[128];            // Joystick name
+	char pad_name[128];        // Game controller name
+	char mapping[1024];        // Empty if not a game controller
+	Sint32 is_gamepad;         // Or DEVICE_MAPPING_STALE
+	Sint32 num_axes;
+	Sint32 num_buttons;
+	Sint32 num_hats;
+	Sint32 num_balls;
+	Sint32 haptic;             // DEVICE_HAPTIC_*
+	Sint16 axis_min[DEVICE_CACHE_AXES]; // Calibration, axis range seen so far
+	Sint16 axis_max[DEVICE_CACHE_AXES];
+	Uint32 opens;
+}DeviceCacheEntry;
+
+typedef struct DeviceCacheHeader
+{
+	char magic[8];
+	Uint32 entry_size;         // sizeof(DeviceCacheEntry) of the writing program
+	Uint32 count;
+}DeviceCacheHeader;
+
+typedef struct DeviceOpenStats
+{
+	const char *name;
+	Uint32 opens;
+	Uint64 sum;                // Performance counter ticks
+	Uint64 max;
+}DeviceOpenStats;
+
+DeviceCacheEntry SDL_device_cache[DEVICE_CACHE_MAX];
+int SDL_device_cache_count = 0;
+int SDL_device_cache_evict = 0;
+const char *SDL_device_cache_path = NULL;
+DeviceCacheEntry *SDL_device_cache_current = NULL; // Entry of the device in use
+int SDL_device_cache_warm = 0;                     // Device in use was found in the cache
+Uint64 SDL_device_open_start = 0;
+DeviceOpenStats SDL_device_open_stats[2] = {
+	{"cold"}, {"warm"},
+};
+char SDL_device_open_log[8192];                    // Output held back while an open is timed
+size_t SDL_device_open_log_len = 0;
+
+// printf() for the device open path. While the open is timed the output is
+// held back and printed by SDL2_Device_Cache_Account(), so printing is not
+// part of the open time.
+void SDL2_Device_Printf(const char *fmt, ...)
+{
+	size_t room = sizeof(SDL_device_open_log) - SDL_device_open_log_len;
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	if (!SDL_device_open_start) {
+		vprintf(fmt, ap);
+		va_end(ap);
+		return;
+	}
+	n = SDL_vsnprintf(SDL_device_open_log + SDL_device_open_log_len, room, fmt, ap);
+	va_end(ap);
+	if (n < 0)
+		return;
+	if ((size_t)n < room) {
+		SDL_device_open_log_len += n;
+		return;
+	}
+	// Full, print the held back output and this message
+	SDL_device_open_log[SDL_device_open_log_len] = '\0';
+	fputs(SDL_device_open_log, stdout);
+	SDL_device_open_log_len = 0;
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+}
+
+void SDL2_Device_Printf_Flush(void)
+{
+	fwrite(SDL_device_open_log, 1, SDL_device_open_log_len, stdout);
+	SDL_device_open_log_len = 0;
+}
+
+DeviceCacheEntry *SDL2_Device_Cache_Find(SDL_JoystickGUID guid)
+{
+	int i;
+
+	for (i = 0; i < SDL_device_cache_count; i++) {
+		if (SDL_memcmp(&SDL_device_cache[i].guid, &guid, sizeof(guid)) == 0)
+			return &SDL_device_cache[i];
+	}
+
+	return NULL;
+}
+
+// Game controller name and mapping of device_index, which depend on the
+// mappings loaded and not only on the device. The mapping is the one of the
+// open gamepad, if any.
+void SDL2_Device_Cache_Probe_Mapping(DeviceCacheEntry *e, int device_index)
+{
+	const char *name;
+	char *mapping;
+
+	e->is_gamepad = gamepad ? SDL_TRUE : SDL_IsGameController(device_index);
+	e->pad_name[0] = '\0';
+	e->mapping[0] = '\0';
+	if (!e->is_gamepad)
+		return;
+	name = SDL_GameControllerNameForIndex(device_index);
+	SDL_strlcpy(e->pad_name, name ? name : "", sizeof(e->pad_name));
+	mapping = gamepad ? SDL_GameControllerMapping(gamepad) : SDL_GameControllerMappingForGUID(e->guid);
+	if (mapping) {
+		SDL_strlcpy(e->mapping, mapping, sizeof(e->mapping));
+		SDL_free(mapping);
+	}
+}
+
+// The mappings loaded have changed, every cached mapping may be wrong.
+void SDL2_Device_Cache_Invalidate_Mappings(void)
+{
+	int i;
+
+	for (i = 0; i < SDL_device_cache_count; i++)
+		SDL_device_cache[i].is_gamepad = DEVICE_MAPPING_STALE;
+}
+
+// Cache entry of the opened device_index. Only a cold open probes the device.
+// A warm open trusts the cached mapping unless it has been invalidated.
+DeviceCacheEntry *SDL2_Device_Cache_Get(int device_index, SDL_Joystick *j)
+{
+	SDL_JoystickGUID guid = SDL_JoystickGetDeviceGUID(device_index);
+	DeviceCacheEntry *e = SDL2_Device_Cache_Find(guid);
+	const char *name;
+	int i;
+
+	if (e) {
+		SDL_device_cache_warm = 1;
+		e->opens++;
+		if (e->is_gamepad == DEVICE_MAPPING_STALE)
+			SDL2_Device_Cache_Probe_Mapping(e, device_index);
+		return e;
+	}
+
+	SDL_device_cache_warm = 0;
+	if (SDL_device_cache_count < DEVICE_CACHE_MAX)
+		e = &SDL_device_cache[SDL_device_cache_count++];
+	else
+		e = &SDL_device_cache[SDL_device_cache_evict++ % DEVICE_CACHE_MAX];
+	SDL_memset(e, 0, sizeof(*e));
+	e->guid = guid;
+	SDL_JoystickGetGUIDString(guid, e->guid_string, sizeof(e->guid_string));
+	name = SDL_JoystickNameForIndex(device_index);
+	SDL_strlcpy(e->name, name ? name : "", sizeof(e->name));
+	SDL2_Device_Cache_Probe_Mapping(e, device_index);
+	e->num_axes = SDL_JoystickNumAxes(j);
+	e->num_buttons = SDL_JoystickNumButtons(j);
+	e->num_hats = SDL_JoystickNumHats(j);
+	e->num_balls = SDL_JoystickNumBalls(j);
+	e->haptic = DEVICE_HAPTIC_UNKNOWN;
+	for (i = 0; i < DEVICE_CACHE_AXES; i++) {
+		e->axis_min[i] = 32767;
+		e->axis_max[i] = -32768;
+	}
+	e->opens = 1;
+
+	return e;
+}
+
+// Called when joy (and gamepad, if opened as game controller) has been opened
+// from device_index. Makes the device cache entry current and prints it.
+void SDL2_Device_Cache_Opened(int device_index)
+{
+	DeviceCacheEntry *e = SDL2_Device_Cache_Get(device_index, joy);
+	int i;
+
+	SDL_device_cache_current = e;
+	if (gamepad) {
+		// Remember that gamepads do not have hats in SDL2
+		SDL2_Device_Printf( "Opened gamepad device index %i (%s)\n", device_index, e->pad_name);
+		SDL2_Device_Printf( "        axes: %d\n", e->num_axes );
+		SDL2_Device_Printf( "     buttons: %d\n", e->num_buttons );
+		SDL2_Device_Printf( " instance id: %d\n", instanceID );
+		SDL2_Device_Printf( "        guid: %s\n", e->guid_string);
+		SDL2_Device_Printf( "     mapping: %s\n", e->mapping);
+	} else {
+		SDL2_Device_Printf( "Opened joystick device index %i (%s)\n", device_index, e->name);
+		SDL2_Device_Printf( "        axes: %d\n", e->num_axes );
+		SDL2_Device_Printf( "     buttons: %d\n", e->num_buttons );
+		SDL2_Device_Printf( "        hats: %d\n", e->num_hats );
+		SDL2_Device_Printf( "       balls: %d\n", e->num_balls );
+		SDL2_Device_Printf( " instance id: %d\n", instanceID );
+		SDL2_Device_Printf( "        guid: %s\n", e->guid_string);
+
+		SDL_joystick_has_hat = 0;
+		if( e->num_hats )
+			SDL_joystick_has_hat = 1;
+	}
+	SDL2_Device_Printf( "       cache: %s, opened %u times\n", SDL_device_cache_warm ? "warm" : "cold", e->opens);
+	for (i = 0; i < DEVICE_CACHE_AXES; i++) {
+		if (e->axis_min[i] <= e->axis_max[i])
+			SDL2_Device_Printf( " calibration: axis %02i range %6i %6i\n", i, e->axis_min[i], e->axis_max[i]);
+	}
+}
+
+// Called when the device in use is closed.
+void SDL2_Device_Cache_Closed(void)
+{
+	SDL_device_cache_current = NULL;
+	SDL_device_open_start = 0;
+}
+
+// Account the time from SDL_device_open_start until the device in use was
+// ready, rumble and sensors included, then print the output held back.
+void SDL2_Device_Cache_Account(void)
+{
+	DeviceOpenStats *st = &SDL_device_open_stats[SDL_device_cache_warm];
+	Uint64 ticks = SDL_GetPerformanceCounter() - SDL_device_open_start;
+
+	if (SDL_device_open_start && SDL_device_cache_current) {
+		st->opens++;
+		st->sum += ticks;
+		if (ticks > st->max)
+			st->max = ticks;
+	}
+	SDL_device_open_start = 0;
+	SDL2_Device_Printf_Flush();
+}
+
+// Joystick axis events of the device in use update its calibration.
+static inline void SDL2_Device_Cache_Calibrate(const SDL_JoyAxisEvent *ja)
+{
+	DeviceCacheEntry *e = SDL_device_cache_current;
+
+	if (!e || ja->which != instanceID || ja->axis >= DEVICE_CACHE_AXES)
+		return;
+	if (ja->value < e->axis_min[ja->axis])
+		e->axis_min[ja->axis] = ja->value;
+	if (ja->value > e->axis_max[ja->axis])
+		e->axis_max[ja->axis] = ja->value;
+}
+
+// Load the cache of previous sessions. Cached mappings are trusted until the
+// mapping DB is loaded or SDL reports a remapped controller.
+void SDL2_Device_Cache_Load(const char *path)
+{
+	DeviceCacheHeader header;
+	FILE *f = fopen(path, "rb");
+	int i;
+
+	if (!f) {
+		printf("Device cache: %s not found, starting empty\n", path);
+		return;
+	}
+	if (fread(&header, sizeof(header), 1, f) != 1 ||
+	    SDL_memcmp(header.magic, DEVICE_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+	    header.entry_size != sizeof(DeviceCacheEntry)) {
+		printf("Device cache: %s has an incompatible layout, ignored\n", path);
+		fclose(f);
+		return;
+	}
+	if (header.count > DEVICE_CACHE_MAX)
+		header.count = DEVICE_CACHE_MAX;
+	SDL_device_cache_count = fread(SDL_device_cache, sizeof(DeviceCacheEntry), header.count, f);
+	fclose(f);
+	for (i = 0; i < SDL_device_cache_count; i++) {
+		DeviceCacheEntry *e = &SDL_device_cache[i];
+
+		e->guid_string[sizeof(e->guid_string) - 1] = '\0';
+		e->name[sizeof(e->name) - 1] = '\0';
+		e->pad_name[sizeof(e->pad_name) - 1] = '\0';
+		e->mapping[sizeof(e->mapping) - 1] = '\0';
+	}
+	printf("Device cache: loaded %i devices from %s\n", SDL_device_cache_count, path);
+}
+
+void SDL2_Device_Cache_Save(const char *path)
+{
+	DeviceCacheHeader header;
+	FILE *f = fopen(path, "wb");
+
+	if (!f) {
+		printf("Device cache: cannot write %s\n", path);
+		return;
+	}
+	SDL_memset(&header, 0, sizeof(header));
+	SDL_memcpy(header.magic, DEVICE_CACHE_MAGIC, sizeof(header.magic));
+	header.entry_size = sizeof(DeviceCacheEntry);
+	header.count = SDL_device_cache_count;
+	fwrite(&header, sizeof(header), 1, f);
+	fwrite(SDL_device_cache, sizeof(DeviceCacheEntry), SDL_device_cache_count, f);
+	fclose(f);
+	printf("Device cache: saved %i devices to %s\n", SDL_device_cache_count, path);
+}
+
+void SDL2_Device_Cache_Report(void)
+{
+	double freq = (double)SDL_GetPerformanceFrequency();
+	int i;
+
+	if (!SDL_device_open_stats[0].opens && !SDL_device_open_stats[1].opens)
+		return;
+	printf("Device open times (open to ready, rumble included)\n");
+	printf(" %-5s %6s  %10s  %10s\n", "open", "count", "avg us", "max us");
+	for (i = 0; i < 2; i++) {
+		const DeviceOpenStats *st = &SDL_device_open_stats[i];
+
+		printf(" %-5s %6u  %10.1f  %10.1f\n", st->name, st->opens,
+		       st->opens ? st->sum * 1000000.0 / freq / st->opens : 0.0,
+		       st->max * 1000000.0 / freq);
+	}
+}
+
+void SDL2_Init_Haptic_From_Joystick(void)
+{
+    DeviceCacheEntry *e = SDL_device_cache_current;
+
+    // Known device, skip the haptic and rumble probes
+    if (joy && e && e->haptic != DEVICE_HAPTIC_UNKNOWN) {
+        if (e->haptic == DEVICE_HAPTIC_NONE) {
+            SDL2_Device_Printf("Joystick does not support haptics/rumble (cached)\n");
+            return;
+        }
+        haptic = SDL_HapticOpenFromJoystick( joy );
+        if (haptic && SDL_HapticRumbleInit(haptic) == 0) {
+            SDL2_Device_Printf( "Sys_InitInput: Rumble initialization OK (cached)\n");
+            return;
+        }
+        // Stale cache entry, probe again
+        SDL2_Device_Printf( "WARNING: cached rumble initialization failed: %s\n", SDL_GetError());
+        if (haptic) {
+            SDL_HapticClose(haptic);
+            haptic = NULL;
+        }
+        e->haptic = DEVICE_HAPTIC_UNKNOWN;
+    }
+
+    // Test for haptic num_devices
+    // Mouses may have haptics, and not the joystick we are testing.
+    SDL2_Device_Printf("Sys_InitInput: %d haptic devices detected.\n", SDL_NumHaptics());
+
+    // Try to open haptic from used joystick
+    if (joy) {
+        if (SDL_JoystickIsHaptic(joy)) {
+			haptic = SDL_HapticOpenFromJoystick( joy );
+			if( haptic == NULL ) {
+				SDL2_Device_Printf( "SDL_HapticOpenFromJoystick() failed: %s\n", SDL_GetError() );
+			} else {
+				if( SDL_HapticRumbleSupported(haptic) == SDL_FALSE) {
+					SDL2_Device_Printf( "WARNING: Rumble not supported!\n");
+					if (e)
+						e->haptic = DEVICE_HAPTIC_NONE;
+					SDL_HapticClose(haptic);
+					haptic = NULL;
+				} else {
+					if (SDL_HapticRumbleInit(haptic) != 0) {
+						SDL2_Device_Printf( "WARNING: to initialize rumble: %s\n", SDL_GetError());
+						SDL_HapticClose(haptic);
+						haptic = NULL;
+					} else {
+						SDL2_Device_Printf( "Sys_InitInput: Rumble initialization OK\n");
+						if (e)
+							e->haptic = DEVICE_HAPTIC_RUMBLE;
+					}
+				}
+			}
+		} else {
+			SDL2_Device_Printf("Joystick does not support haptics/rumble\n");
+			haptic = NULL;
+			if (e)
+				e->haptic = DEVICE_HAPTIC_NONE;
+		}
+	}
+}
+
+//
+// Axis response curves.
+// Every curve is precomputed into a 65536 entry table indexed directly by the
+// raw axis value reinterpreted as Uint16, so shaping an event is a single load.
+// Tables are kept in a small registry and shared by everything using the same
+// curve parameters.
+//
+#define CURVE_LINEAR 0
+#define CURVE_EXPO   1
+#define CURVE_SCURVE 2
+#define CURVE_SPLINE 3
+
+#define CURVE_MAX_POINTS   8 // Spline control points, (0,0) and (1,1) included
+#define CURVE_MAX_PROFILES 8
+#define CURVE_LUT_SIZE     65536
+
+typedef struct CurveProfile
+{
+	int type;
+	float param;  // Exponent for expo, steepness for S-curve
+	int num_points;
+	float px[CURVE_MAX_POINTS], py[CURVE_MAX_POINTS];
+	Sint16 *lut;
+	int refs;
+}CurveProfile;
+
+CurveProfile curve_profiles[CURVE_MAX_PROFILES];
+int curve_num_profiles = 0;
+CurveProfile SDL_stick_curve, SDL_trigger_curve;
+const Sint16 *SDL_stick_lut = NULL;
+const Sint16 *SDL_trigger_lut = NULL;
+
+// Parse "linear", "expo[:E]", "scurve[:K]" or "spline:x=y,x=y,...". Returns 0 on success.
+int SDL2_Curve_Parse(const char *spec, CurveProfile *c)
+{
+	SDL_memset(c, 0, sizeof(*c));
+	if (strcmp(spec, "linear") == 0) {
+		c->type = CURVE_LINEAR;
+	} else if (strncmp(spec, "expo", 4) == 0) {
+		c->type = CURVE_EXPO;
+		c->param = spec[4] == ':' ? SDL_atof(spec + 5) : 2.0f;
+		if (c->param <= 0)
+			return -1;
+	} else if (strncmp(spec, "scurve", 6) == 0) {
+		c->type = CURVE_SCURVE;
+		c->param = spec[6] == ':' ? SDL_atof(spec + 7) : 2.0f;
+		if (c->param <= 0)
+			return -1;
+	} else if (strncmp(spec, "spline:", 7) == 0) {
+		const char *p = spec + 7;
+		float x, y;
+		int n;
+
+		c->type = CURVE_SPLINE;
+		c->px[0] = 0;
+		c->py[0] = 0;
+		c->num_points = 1;
+		while (sscanf(p, "%f=%f%n", &x, &y, &n) == 2) {
+			if (c->num_points == CURVE_MAX_POINTS - 1 || x <= c->px[c->num_points - 1] || x >= 1)
+				return -1;
+			c->px[c->num_points] = x;
+			c->py[c->num_points] = y;
+			c->num_points++;
+			p += n;
+			if (*p != ',')
+				break;
+			p++;
+		}
+		if (*p != '\0')
+			return -1;
+		c->px[c->num_points] = 1;
+		c->py[c->num_points] = 1;
+		c->num_points++;
+	} else {
+		return -1;
+	}
+
+	return 0;
+}
+
+// Direct evaluation. x and the result are in -1..1, curves are odd functions.
+float SDL2_Curve_Eval(const CurveProfile *c, float x)
+{
+	float a = x < 0 ? -x : x;
+	float y;
+
+	switch (c->type) {
+		case CURVE_EXPO:
+			y = SDL_pow(a, c->param);
+			break;
+		case CURVE_SCURVE: {
+			float p = SDL_pow(a, c->param);
+
+			y = p / (p + SDL_pow(1 - a, c->param));
+			break;
+		}
+		case CURVE_SPLINE: {
+			// Cubic Hermite between control points, Catmull-Rom tangents
+			int i = 0;
+			float h, t, t2, t3, m0, m1;
+
+			while (i < c->num_points - 2 && a > c->px[i + 1])
+				i++;
+			h = c->px[i + 1] - c->px[i];
+			t = (a - c->px[i]) / h;
+			m0 = i > 0 ? (c->py[i + 1] - c->py[i - 1]) / (c->px[i + 1] - c->px[i - 1]) * h
+			           : c->py[i + 1] - c->py[i];
+			m1 = i < c->num_points - 2 ? (c->py[i + 2] - c->py[i]) / (c->px[i + 2] - c->px[i]) * h
+			                           : c->py[i + 1] - c->py[i];
+			t2 = t * t;
+			t3 = t2 * t;
+			y = (2 * t3 - 3 * t2 + 1) * c->py[i] + (t3 - 2 * t2 + t) * m0 +
+			    (-2 * t3 + 3 * t2) * c->py[i + 1] + (t3 - t2) * m1;
+			break;
+		}
+		default:
+			y = a;
+			break;
+	}
+	if (y > 1)
+		y = 1;
+	if (y < 0)
+		y = 0;
+
+	return x < 0 ? -y : y;
+}
+
+Sint16 SDL2_Curve_Apply_Direct(const CurveProfile *c, Sint16 value)
+{
+	float x = value < -32767 ? -1.0f : value / 32767.0f;
+
+	return (Sint16)SDL_floor(SDL2_Curve_Eval(c, x) * 32767.0f + 0.5f);
+}
+
+// Returns the table for this curve, generating it the first time it is used.
+const Sint16 *SDL2_Curve_Acquire(const CurveProfile *c)
+{
+	CurveProfile *p;
+	int i;
+
+	for (i = 0; i < curve_num_profiles; i++) {
+		p = &curve_profiles[i];
+		if (p->type == c->type && p->param == c->param && p->num_points == c->num_points &&
+		    memcmp(p->px, c->px, sizeof(p->px)) == 0 && memcmp(p->py, c->py, sizeof(p->py)) == 0) {
+			p->refs++;
+			return p->lut;
+		}
+	}
+	if (curve_num_profiles == CURVE_MAX_PROFILES)
+		return NULL;
+
+	p = &curve_profiles[curve_num_profiles];
+	*p = *c;
+	p->lut = (Sint16 *)SDL_malloc(CURVE_LUT_SIZE * sizeof(Sint16));
+	if (!p->lut)
+		return NULL;
+	for (i = 0; i < CURVE_LUT_SIZE; i++)
+		p->lut[i] = SDL2_Curve_Apply_Direct(c, (Sint16)(Uint16)i);
+	p->refs = 1;
+	curve_num_profiles++;
+
+	return p->lut;
+}
+
+void SDL2_Curve_Release_All(void)
+{
+	int i;
+
+	for (i = 0; i < curve_num_profiles; i++)
+		SDL_free(curve_profiles[i].lut);
+	curve_num_profiles = 0;
+	SDL_stick_lut = NULL;
+	SDL_trigger_lut = NULL;
+}
+
+static inline Sint16 SDL2_Curve_Lookup(const Sint16 *lut, Sint16 value)
+{
+	return lut[(Uint16)value];
+}
+
+// Lookup table against direct evaluation, with the table and the values in
+// cache (warm) and after evicting the caches before every batch (cold).
+void SDL2_Curve_Bench(void)
+{
+	const char *names[] = {"linear", "expo:2.5", "scurve:3", "spline:0.2=0.05,0.5=0.3,0.8=0.75"};
+	const int warm_values = 256, warm_rounds = 20000;
+	const int cold_batch = 64, cold_rounds = 200;
+	const size_t flush_size = 32 * 1024 * 1024;
+	double freq = (double)SDL_GetPerformanceFrequency();
+	Uint8 *flush = (Uint8 *)SDL_malloc(flush_size);
+	Sint16 values[256];
+	volatile Sint32 sink = 0;
+	Uint32 rnd = 0x12345678;
+	int c, r, i;
+
+	if (!flush) {
+		printf("Out of memory\n");
+		return;
+	}
+	SDL_memset(flush, 1, flush_size);
+	printf("Curve                                 Warm LUT ns  Warm direct ns  Cold LUT ns  Cold direct ns\n");
+	for (c = 0; c < (int)SDL_arraysize(names); c++) {
+		CurveProfile curve;
+		const Sint16 *lut;
+		double ns[4] = {0, 0, 0, 0};
+		Uint64 t0;
+		Sint32 acc;
+
+		SDL2_Curve_Parse(names[c], &curve);
+		lut = SDL2_Curve_Acquire(&curve);
+		for (i = 0; i < warm_values; i++)
+			values[i] = (Sint16)SDL2_Random(&rnd);
+
+		// Warm
+		acc = 0;
+		t0 = SDL_GetPerformanceCounter();
+		for (r = 0; r < warm_rounds; r++)
+			for (i = 0; i < warm_values; i++)
+				acc += SDL2_Curve_Lookup(lut, values[i]);
+		ns[0] = (SDL_GetPerformanceCounter() - t0) * 1e9 / freq / ((double)warm_rounds * warm_values);
+		sink += acc;
+		acc = 0;
+		t0 = SDL_GetPerformanceCounter();
+		for (r = 0; r < warm_rounds / 100; r++)
+			for (i = 0; i < warm_values; i++)
+				acc += SDL2_Curve_Apply_Direct(&curve, values[i]);
+		ns[1] = (SDL_GetPerformanceCounter() - t0) * 1e9 / freq / ((double)(warm_rounds / 100) * warm_values);
+		sink += acc;
+
+		// Cold. Only the batches are timed, not the cache eviction.
+		for (r = 0; r < cold_rounds; r++) {
+			size_t k;
+
+			for (i = 0; i < cold_batch; i++)
+				values[i] = (Sint16)SDL2_Random(&rnd);
+			for (k = 0; k < flush_size; k += 64)
+				flush[k]++;
+			acc = 0;
+			t0 = SDL_GetPerformanceCounter();
+			for (i = 0; i < cold_batch; i++)
+				acc += SDL2_Curve_Lookup(lut, values[i]);
+			ns[2] += (SDL_GetPerformanceCounter() - t0) * 1e9 / freq;
+			sink += acc;
+
+			for (k = 0; k < flush_size; k += 64)
+				flush[k]++;
+			acc = 0;
+			t0 = SDL_GetPerformanceCounter();
+			for (i = 0; i < cold_batch; i++)
+				acc += SDL2_Curve_Apply_Direct(&curve, values[i]);
+			ns[3] += (SDL_GetPerformanceCounter() - t0) * 1e9 / freq;
+			sink += acc;
+		}
+		ns[2] /= (double)cold_rounds * cold_batch;
+		ns[3] /= (double)cold_rounds * cold_batch;
+
+		printf(" %-36s %11.2f  %14.2f  %11.2f  %14.2f\n", names[c], ns[0], ns[1], ns[2], ns[3]);
+	}
+	SDL_free(flush);
+	SDL2_Curve_Release_All();
+}
+
+//
+// Event queue instrumentation.
+// SDL drops events silently when its queue is full. An event watch sees every
+// event before it is added to the queue, so comparing what the watch saw with
+// what the loop dequeued tells how many events of each device were lost.
+// The optional event filter runs even before the watch: it drops axis events
+// inside the dead zone and tracks button state, so button state is known even
+// if the button event is lost in the queue.
+//
+#define QUEUE_CAPACITY    65535 // SDL_MAX_QUEUED_EVENTS in SDL_events.c
+#define QUEUE_MAX_DEVICES 16
+#define QUEUE_SAMPLE_US   1000  // Queue depth sampling interval
+
+typedef struct QueueDeviceStats
+{
+	SDL_JoystickID instanceID;
+	Uint64 pushed;       // Seen by the event watch
+	Uint64 received;     // Dequeued by the main loop
+	Uint64 ups_pushed;   // Button up events
+	Uint64 ups_received;
+	Uint64 filtered;     // Handled by the event filter, never queued
+	Uint32 buttons;      // Button state tracked by the event filter
+}QueueDeviceStats;
+
+int SDL_queue_stats = 0;
+int SDL_queue_event_filter = 0;
+int SDL_queue_flood_count = 0;
+Uint32 SDL_queue_flood_type = 0;
+SDL_Thread *SDL_queue_flood_thread = NULL;
+SDL_atomic_t SDL_queue_flood_rejected;
+Sint32 SDL_queue_flood_expected = 0;
+Uint64 SDL_queue_flood_gaps = 0;
+Uint64 SDL_queue_flood_received = 0;
+
+QueueDeviceStats queue_devices[QUEUE_MAX_DEVICES];
+int queue_num_devices = 0;
+Uint64 queue_depth_interval = 0;  // QUEUE_SAMPLE_US in performance counter ticks
+Uint64 queue_depth_last = 0;
+Uint64 queue_depth_samples = 0;
+Uint64 queue_depth_sum = 0;
+int queue_depth_max = 0;
+Uint64 queue_depth_saturated = 0; // Samples with the queue over 90% full
+
+int SDL2_Queue_Is_Device_Event(const SDL_Event *ev)
+{
+	switch (ev->type) {
+		case SDL_JOYAXISMOTION:
+		case SDL_JOYHATMOTION:
+		case SDL_JOYBUTTONDOWN:
+		case SDL_JOYBUTTONUP:
+		case SDL_CONTROLLERAXISMOTION:
+		case SDL_CONTROLLERBUTTONDOWN:
+		case SDL_CONTROLLERBUTTONUP:
+			return 1;
+	}
+
+	return 0;
+}
+
+int SDL2_Queue_Is_Button_Up(const SDL_Event *ev)
+{
+	return ev->type == SDL_JOYBUTTONUP || ev->type == SDL_CONTROLLERBUTTONUP;
+}
+
+// All device events have the instance id at the same offset.
+QueueDeviceStats *SDL2_Queue_Get_Device(SDL_JoystickID id)
+{
+	int i;
+
+	for (i = 0; i < queue_num_devices; i++) {
+		if (queue_devices[i].instanceID == id)
+			return &queue_devices[i];
+	}
+	if (queue_num_devices == QUEUE_MAX_DEVICES)
+		return NULL;
+	SDL_memset(&queue_devices[queue_num_devices], 0, sizeof(QueueDeviceStats));
+	queue_devices[queue_num_devices].instanceID = id;
+
+	return &queue_devices[queue_num_devices++];
+}
+
+int SDL2_Queue_Event_Filter(void *userdata, SDL_Event *ev)
+{
+	QueueDeviceStats *dev;
+
+	if (!SDL2_Queue_Is_Device_Event(ev) || !(dev = SDL2_Queue_Get_Device(ev->jaxis.which)))
+		return 1;
+
+	switch (ev->type) {
+		case SDL_JOYAXISMOTION:
+		case SDL_CONTROLLERAXISMOTION:
+			if (!SDL2_Dead_Zone_Passes(ev->jaxis.value)) {
+				dev->filtered++;
+				return 0;
+			}
+			break;
+		case SDL_JOYBUTTONDOWN:
+		case SDL_JOYBUTTONUP:
+			if (ev->jbutton.button < 32) {
+				if (ev->jbutton.state == SDL_PRESSED)
+					dev->buttons |= 1u << ev->jbutton.button;
+				else
+					dev->buttons &= ~(1u << ev->jbutton.button);
+			}
+			break;
+	}
+
+	return 1;
+}
+
+int SDL2_Queue_Event_Watch(void *userdata, SDL_Event *ev)
+{
+	QueueDeviceStats *dev;
+
+	if (!SDL2_Queue_Is_Device_Event(ev) || !(dev = SDL2_Queue_Get_Device(ev->jaxis.which)))
+		return 0;
+	dev->pushed++;
+	if (SDL2_Queue_Is_Button_Up(ev))
+		dev->ups_pushed++;
+
+	return 0;
+}
+
+int SDL2_Queue_Flood_Thread(void *data)
+{
+	SDL_Event event;
+	int i;
+
+	for (i = 0; i < SDL_queue_flood_count; i++) {
+		SDL_memset(&event, 0, sizeof(event));
+		event.type = SDL_queue_flood_type;
+		event.user.code = i;
+		if (SDL_PushEvent(&event) < 0)
+			SDL_AtomicAdd(&SDL_queue_flood_rejected, 1);
+	}
+
+	return 0;
+}
+
+void SDL2_Queue_Init(void)
+{
+	queue_depth_interval = SDL_GetPerformanceFrequency() * QUEUE_SAMPLE_US / 1000000;
+	if (SDL_queue_event_filter)
+		SDL_SetEventFilter(SDL2_Queue_Event_Filter, NULL);
+	SDL_AddEventWatch(SDL2_Queue_Event_Watch, NULL);
+
+	if (SDL_queue_flood_count > 0) {
+		SDL_queue_flood_type = SDL_RegisterEvents(1);
+		SDL_AtomicSet(&SDL_queue_flood_rejected, 0);
+		printf("Flooding the event queue with %i sequence numbered events\n", SDL_queue_flood_count);
+		SDL_queue_flood_thread = SDL_CreateThread(SDL2_Queue_Flood_Thread, "queue_flood", NULL);
+	}
+}
+
+// Called for every dequeued event.
+void SDL2_Queue_Received(const SDL_Event *ev)
+{
+	Uint64 now = SDL_GetPerformanceCounter();
+	QueueDeviceStats *dev;
+
+	// Peeking walks the whole queue with the queue locked, blocking the
+	// producers. The depth is only sampled every QUEUE_SAMPLE_US.
+	if (now - queue_depth_last >= queue_depth_interval) {
+		int depth = SDL_PeepEvents(NULL, 0, SDL_PEEKEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT);
+
+		queue_depth_last = now;
+		if (depth >= 0) {
+			queue_depth_samples++;
+			queue_depth_sum += depth;
+			if (depth > queue_depth_max)
+				queue_depth_max = depth;
+			if (depth >= QUEUE_CAPACITY * 9 / 10)
+				queue_depth_saturated++;
+		}
+	}
+
+	if (SDL_queue_flood_type && ev->type == SDL_queue_flood_type) {
+		if (ev->user.code != SDL_queue_flood_expected) {
+			printf("Flood sequence gap: expected %i got %i\n", SDL_queue_flood_expected, ev->user.code);
+			SDL_queue_flood_gaps += ev->user.code - SDL_queue_flood_expected;
+		}
+		SDL_queue_flood_expected = ev->user.code + 1;
+		SDL_queue_flood_received++;
+		return;
+	}
+
+	if (SDL2_Queue_Is_Device_Event(ev) && (dev = SDL2_Queue_Get_Device(ev->jaxis.which))) {
+		dev->received++;
+		if (SDL2_Queue_Is_Button_Up(ev))
+			dev->ups_received++;
+	}
+}
+
+void SDL2_Queue_Report(void)
+{
+	SDL_Event pending[256];
+	Uint64 pending_count[QUEUE_MAX_DEVICES];
+	int n, i, j;
+
+	if (SDL_queue_flood_thread) {
+		SDL_WaitThread(SDL_queue_flood_thread, NULL);
+		SDL_queue_flood_thread = NULL;
+	}
+	SDL_DelEventWatch(SDL2_Queue_Event_Watch, NULL);
+	if (SDL_queue_event_filter)
+		SDL_SetEventFilter(NULL, NULL);
+
+	// Events still in the queue are not lost
+	SDL_memset(pending_count, 0, sizeof(pending_count));
+	while ((n = SDL_PeepEvents(pending, SDL_arraysize(pending), SDL_GETEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT)) > 0) {
+		for (j = 0; j < n; j++) {
+			for (i = 0; i < queue_num_devices; i++) {
+				if (SDL2_Queue_Is_Device_Event(&pending[j]) && queue_devices[i].instanceID == pending[j].jaxis.which)
+					pending_count[i]++;
+			}
+		}
+	}
+
+	printf("Event queue depth: avg %.1f max %i (capacity %i), %llu of %llu samples over 90%% full (1 sample every %i us)\n",
+	       queue_depth_samples ? (double)queue_depth_sum / queue_depth_samples : 0.0,
+	       queue_depth_max, QUEUE_CAPACITY, (unsigned long long)queue_depth_saturated,
+	       (unsigned long long)queue_depth_samples, QUEUE_SAMPLE_US);
+	printf(" Device     Pushed   Received   Filtered      Lost  Button ups lost  Buttons held\n");
+	for (i = 0; i < queue_num_devices; i++) {
+		QueueDeviceStats *dev = &queue_devices[i];
+
+		printf(" %6i  %9llu  %9llu  %9llu  %8lld  %15lld    0x%08x\n", dev->instanceID,
+		       (unsigned long long)dev->pushed, (unsigned long long)dev->received,
+		       (unsigned long long)dev->filtered,
+		       (long long)(dev->pushed - dev->received - pending_count[i]),
+		       (long long)(dev->ups_pushed - dev->ups_received), dev->buttons);
+	}
+	if (SDL_queue_flood_count > 0) {
+		printf("Flood: %i pushed, %llu received, %i rejected by SDL_PushEvent() (queue full), %llu seen as sequence gaps\n",
+		       SDL_queue_flood_count, (unsigned long long)SDL_queue_flood_received,
+		       SDL_AtomicGet(&SDL_queue_flood_rejected), (unsigned long long)SDL_queue_flood_gaps);
+	}
+}
+
+#ifdef __SDL2_ENABLE_SENSORS
+//
+// Sensor streaming mode.
+// Motion aiming needs 500 Hz-1 kHz gyro data, so samples go into a preallocated
+// structure-of-arrays ring and nothing is allocated or printed per sample.
+// Orientation is integrated in batches with a complementary filter: the gyro
+// is integrated and pitch/roll are slowly pulled towards the gravity vector
+// measured by the accelerometer with a fixed time constant, whatever the
+// sensor rate.
+//
+#define SENSOR_RING_SIZE   8192  // Must be a power of two
+#define SENSOR_BATCH       32    // Samples integrated at once
+#define SENSOR_FILTER_TAU  0.5f  // Complementary filter time constant (s)
+#define SENSOR_STATS_MAX   2     // Accelerometer and gyro
+
+typedef struct SensorRing
+{
+	Uint64 t_us[SENSOR_RING_SIZE];
+	float x[SENSOR_RING_SIZE];
+	float y[SENSOR_RING_SIZE];
+	float z[SENSOR_RING_SIZE];
+	Uint8 type[SENSOR_RING_SIZE];
+	Uint32 head;  // Next sample to write
+	Uint32 tail;  // Next sample to integrate
+}SensorRing;
+
+typedef struct SensorStats
+{
+	const char *name;
+	Uint64 samples;
+	Uint64 last_us;
+	double dt_sum, dt_sum2;  // Sample interval sum and sum of squares (us)
+	Uint64 dt_min, dt_max;
+	Uint64 window_start_us;  // Rate measured over 1 second windows
+	Uint32 window_samples;
+	float rate;
+}SensorStats;
+
+int SDL_sensor_mode = 0;
+int SDL_sensor_synthetic_hz = 0;
+SDL_TimerID SDL_sensor_synthetic_timer = 0;
+SensorRing sensor_ring;
+SensorStats sensor_stats[SENSOR_STATS_MAX] = { {"accel"}, {"gyro"} };
+float sensor_pitch = 0, sensor_roll = 0, sensor_yaw = 0; // Degrees
+Uint64 sensor_last_gyro_us = 0;
+Uint64 sensor_last_accel_us = 0;
+Uint64 sensor_last_print_us = 0;
+
+void SDL2_Init_Sensors_From_Gamepad(void)
+{
+	SDL_SensorType types[SENSOR_STATS_MAX] = { SDL_SENSOR_ACCEL, SDL_SENSOR_GYRO };
+	int i;
+
+	if (!SDL_sensor_mode || !gamepad)
+		return;
+	for (i = 0; i < SENSOR_STATS_MAX; i++) {
+		if (!SDL_GameControllerHasSensor(gamepad, types[i])) {
+			SDL2_Device_Printf("Gamepad has no %s sensor\n", sensor_stats[i].name);
+			continue;
+		}
+		if (SDL_GameControllerSetSensorEnabled(gamepad, types[i], SDL_TRUE) != 0) {
+			SDL2_Device_Printf("SDL_GameControllerSetSensorEnabled(%s) failed: %s\n", sensor_stats[i].name, SDL_GetError());
+			continue;
+		}
+#if SDL_VERSION_ATLEAST(2, 0, 16)
+		SDL2_Device_Printf("Sensor %s enabled, %.0f Hz\n", sensor_stats[i].name,
+		       SDL_GameControllerGetSensorDataRate(gamepad, types[i]));
+#else
+		SDL2_Device_Printf("Sensor %s enabled\n", sensor_stats[i].name);
+#endif
+	}
+}
+
+// Integrate the samples between tail and head into the orientation.
+void SDL2_Sensor_Integrate(void)
+{
+	const float rad2deg = 57.29578f;
+	SensorRing *r = &sensor_ring;
+
+	for (; r->tail != r->head; r->tail++) {
+		Uint32 k = r->tail & (SENSOR_RING_SIZE - 1);
+
+		if (r->type[k] == SDL_SENSOR_GYRO) {
+			if (sensor_last_gyro_us) {
+				float dt = (r->t_us[k] - sensor_last_gyro_us) * 1e-6f;
+
+				// Gyro is in rad/s: x pitch, y yaw, z roll
+				sensor_pitch += r->x[k] * dt * rad2deg;
+				sensor_yaw += r->y[k] * dt * rad2deg;
+				sensor_roll += r->z[k] * dt * rad2deg;
+			}
+			sensor_last_gyro_us = r->t_us[k];
+		} else {
+			// Accelerometer is in m/s^2, gravity points along -y when the pad lies flat
+			float accel_pitch = SDL_atan2(r->z[k], r->y[k]) * rad2deg;
+			float accel_roll = SDL_atan2(-r->x[k], r->y[k]) * rad2deg;
+
+			if (sensor_last_accel_us) {
+				// Gyro weight of this sample, from its interval
+				float dt = (r->t_us[k] - sensor_last_accel_us) * 1e-6f;
+				float alpha = SENSOR_FILTER_TAU / (SENSOR_FILTER_TAU + dt);
+
+				sensor_pitch = alpha * sensor_pitch + (1 - alpha) * accel_pitch;
+				sensor_roll = alpha * sensor_roll + (1 - alpha) * accel_roll;
+			}
+			sensor_last_accel_us = r->t_us[k];
+		}
+	}
+}
+
+// Performance counter in microseconds. Counter * 1000000 overflows after a
+// few hours of uptime with a nanosecond counter, so whole seconds and the
+// remainder are converted apart.
+static inline Uint64 SDL2_Sensor_Now_Us(void)
+{
+	Uint64 counter = SDL_GetPerformanceCounter();
+	Uint64 freq = SDL_GetPerformanceFrequency();
+
+	return counter / freq * 1000000 + counter % freq * 1000000 / freq;
+}
+
+// Hot path. Called for every SDL_CONTROLLERSENSORUPDATE event.
+void SDL2_Sensor_Update(const SDL_ControllerSensorEvent *se)
+{
+	SensorRing *r = &sensor_ring;
+	SensorStats *st;
+	Uint32 k = r->head & (SENSOR_RING_SIZE - 1);
+	Uint64 t_us = 0;
+
+	if (se->sensor == SDL_SENSOR_ACCEL)
+		st = &sensor_stats[0];
+	else if (se->sensor == SDL_SENSOR_GYRO)
+		st = &sensor_stats[1];
+	else
+		return;
+
+#if SDL_VERSION_ATLEAST(2, 0, 26)
+	t_us = se->timestamp_us;
+#endif
+	if (!t_us && replay.file)
+		t_us = (Uint64)Replay_Ticks(&replay) * 1000;
+	if (!t_us)
+		t_us = SDL2_Sensor_Now_Us();
+
+	r->t_us[k] = t_us;
+	r->x[k] = se->data[0];
+	r->y[k] = se->data[1];
+	r->z[k] = se->data[2];
+	r->type[k] = (Uint8)se->sensor;
+	r->head++;
+
+	if (st->samples) {
+		Uint64 dt = t_us - st->last_us;
+
+		st->dt_sum += dt;
+		st->dt_sum2 += (double)dt * dt;
+		if (st->samples == 1 || dt < st->dt_min)
+			st->dt_min = dt;
+		if (dt > st->dt_max)
+			st->dt_max = dt;
+	} else {
+		st->window_start_us = t_us;
+	}
+	st->samples++;
+	st->last_us = t_us;
+	st->window_samples++;
+	if (t_us - st->window_start_us >= 1000000) {
+		st->rate = st->window_samples * 1e6f / (t_us - st->window_start_us);
+		st->window_start_us = t_us;
+		st->window_samples = 0;
+	}
+
+	if (r->head - r->tail >= SENSOR_BATCH)
+		SDL2_Sensor_Integrate();
+
+	if (t_us - sensor_last_print_us >= 1000000) {
+		printf("Sensors accel %4.0f Hz gyro %4.0f Hz / pitch %7.2f roll %7.2f yaw %7.2f\n",
+		       sensor_stats[0].rate, sensor_stats[1].rate, sensor_pitch, sensor_roll, sensor_yaw);
+		sensor_last_print_us = t_us;
+	}
+}
+
+// Timer callback pushing synthetic sensor events. The timer runs every 1 ms,
+// so each call pushes the samples due since the previous one. Timestamps are
+// generated, not measured, so the same rate always gives the same stream.
+Uint32 SDL2_Sensor_Synthetic_Callback(Uint32 interval, void *param)
+{
+	static Uint64 n = 0;
+	static double due = 0;
+	SDL_Event event;
+
+	due += SDL_sensor_synthetic_hz / 1000.0;
+	while (due >= 1.0) {
+		Uint64 t_us = n * 1000000 / SDL_sensor_synthetic_hz;
+		float phase = (float)(n % 1000) / 1000.0f * 6.2831853f;
+		int i;
+
+		for (i = 0; i < SENSOR_STATS_MAX; i++) {
+			SDL_memset(&event, 0, sizeof(event));
+			event.type = SDL_CONTROLLERSENSORUPDATE;
+			event.csensor.which = -1;
+			event.csensor.sensor = i == 0 ? SDL_SENSOR_ACCEL : SDL_SENSOR_GYRO;
+			if (i == 0) {
+				// Pad lying flat, gravity only
+				event.csensor.data[1] = SDL_STANDARD_GRAVITY;
+			} else {
+				// Slow yaw oscillation
+				event.csensor.data[1] = SDL_sin(phase);
+			}
+#if SDL_VERSION_ATLEAST(2, 0, 26)
+			event.csensor.timestamp_us = t_us + 1; // 0 means "no timestamp"
+#endif
+			SDL_PushEvent(&event);
+		}
+		n++;
+		due -= 1.0;
+	}
+
+	return interval;
+}
+
+void SDL2_Sensor_Report(void)
+{
+	int i;
+
+	SDL2_Sensor_Integrate();
+	printf("Sensor     Samples   Rate Hz  Mean dt us  Jitter us  Min dt us  Max dt us\n");
+	for (i = 0; i < SENSOR_STATS_MAX; i++) {
+		SensorStats *st = &sensor_stats[i];
+		double n = st->samples > 1 ? (double)(st->samples - 1) : 0;
+		double mean = n ? st->dt_sum / n : 0;
+		double var = n ? st->dt_sum2 / n - mean * mean : 0;
+
+		printf(" %-8s %9llu  %8.1f  %10.1f  %9.1f  %9llu  %9llu\n",
+		       st->name, (unsigned long long)st->samples, mean ? 1e6 / mean : 0.0,
+		       mean, var > 0 ? SDL_sqrt(var) : 0.0,
+		       (unsigned long long)st->dt_min, (unsigned long long)st->dt_max);
+	}
+	printf("Orientation pitch %.2f roll %.2f yaw %.2f\n", sensor_pitch, sensor_roll, sensor_yaw);
+}
+#endif
+
+#ifdef __SDL2_ENABLE_DAEMON
+//
+// Daemon mode. Opens every controller (hotplug included), publishes all
+// joystick/controller events into the shared memory ring and serves control
+// commands on a Unix socket. See gamepad_ring_SDL2.h.
+//
+#define DAEMON_MAX_DEVICES 16
+#define DAEMON_MAX_CLIENTS 16
+#define DAEMON_CLIENT_TIMEOUT_MS 1000 // Pending connections are dropped after this
+
+typedef struct DaemonDevice
+{
+	SDL_Joystick *joy;
+	SDL_GameController *gamepad;
+	SDL_Haptic *haptic;
+	SDL_JoystickID instanceID;  // -1 if the slot is free
+	char guid[64];
+}DaemonDevice;
+
+// Control connection waiting for its command
+typedef struct DaemonClient
+{
+	int fd;                     // -1 if the slot is free
+	Uint32 accept_ticks;
+	int len;
+	char cmd[256];
+}DaemonClient;
+
+DaemonDevice daemon_devices[DAEMON_MAX_DEVICES];
+DaemonClient daemon_clients[DAEMON_MAX_CLIENTS];
+GamepadRing *daemon_ring = NULL;
+int daemon_lock_fd = -1;
+int daemon_shm_fd = -1;
+int daemon_socket_fd = -1;
+
+int SDL2_Daemon_Init(void)
+{
+	struct sockaddr_un addr;
+	int i;
+
+	for (i = 0; i < DAEMON_MAX_DEVICES; i++) {
+		SDL_memset(&daemon_devices[i], 0, sizeof(DaemonDevice));
+		daemon_devices[i].instanceID = -1;
+	}
+	for (i = 0; i < DAEMON_MAX_CLIENTS; i++)
+		daemon_clients[i].fd = -1;
+
+	// Single instance. A second daemon would reset the ring and steal the
+	// socket of the running one. The lock is released by the kernel on exit.
+	daemon_lock_fd = open(GAMEPAD_RING_LOCK, O_CREAT | O_RDWR, 0644);
+	if (daemon_lock_fd < 0) {
+		perror("Daemon: open() lock file");
+		return -1;
+	}
+	if (flock(daemon_lock_fd, LOCK_EX | LOCK_NB) < 0) {
+		printf("Daemon: another daemon is already running (%s is locked)\n", GAMEPAD_RING_LOCK);
+		close(daemon_lock_fd);
+		daemon_lock_fd = -1;
+		return -1;
+	}
+
+	daemon_shm_fd = shm_open(GAMEPAD_RING_SHM_NAME, O_CREAT | O_RDWR, 0644);
+	if (daemon_shm_fd < 0) {
+		perror("Daemon: shm_open()");
+		return -1;
+	}
+	if (ftruncate(daemon_shm_fd, sizeof(GamepadRing)) < 0) {
+		perror("Daemon: ftruncate()");
+		return -1;
+	}
+	daemon_ring = (GamepadRing *)mmap(NULL, sizeof(GamepadRing), PROT_READ | PROT_WRITE,
+	                                  MAP_SHARED, daemon_shm_fd, 0);
+	if (daemon_ring == MAP_FAILED) {
+		perror("Daemon: mmap()");
+		daemon_ring = NULL;
+		return -1;
+	}
+	GamepadRing_Init(daemon_ring, ((Uint64)time(NULL) << 32) | (Uint32)getpid());
+
+	daemon_socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (daemon_socket_fd < 0) {
+		perror("Daemon: socket()");
+		return -1;
+	}
+	SDL_memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	SDL_strlcpy(addr.sun_path, GAMEPAD_RING_SOCKET, sizeof(addr.sun_path));
+	unlink(GAMEPAD_RING_SOCKET);
+	if (bind(daemon_socket_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    listen(daemon_socket_fd, 8) < 0) {
+		perror("Daemon: bind()/listen()");
+		return -1;
+	}
+	fcntl(daemon_socket_fd, F_SETFL, O_NONBLOCK);
 
-// This must be enabled by default. We are in 2019, many gamepads are wireless.
-#define __SDL2_ENABLE_CONTROLLER_HOTPLUG
+	printf("Daemon: event ring %s (%i slots), control socket %s\n",
+	       GAMEPAD_RING_SHM_NAME, GAMEPAD_RING_SLOTS, GAMEPAD_RING_SOCKET);
 
-SDL_Joystick *joy = NULL;
-// Game controllers do not have hats or balls, only joysticks have.
-int SDL_joystick_has_hat = 0;
+	return 0;
+}
 
-SDL_GameController *gamepad = NULL;
-SDL_JoystickID instanceID = -1; // Joystick instance ID. Changes if there are hotplug events!!!
-int device_index_in_use = -1; // This is the devic number in use
-const int SDL_wanted_joystick_number = 0; // Joystick device index user wants to use
-SDL_Haptic *haptic = NULL;
+void SDL2_Daemon_Shutdown(void)
+{
+	int i;
 
-int SDL_joystick_is_gamepad = 0; // True if joystick is a SDL2 recognised gamepad
+	for (i = 0; i < DAEMON_MAX_CLIENTS; i++) {
+		if (daemon_clients[i].fd >= 0) {
+			close(daemon_clients[i].fd);
+			daemon_clients[i].fd = -1;
+		}
+	}
+	for (i = 0; i < DAEMON_MAX_DEVICES; i++) {
+		DaemonDevice *dev = &daemon_devices[i];
 
-int SDL_dead_zone = 1000;
+		if (dev->instanceID < 0)
+			continue;
+		if (dev->haptic)
+			SDL_HapticClose(dev->haptic);
+		if (dev->gamepad)
+			SDL_GameControllerClose(dev->gamepad);
+		else
+			SDL_JoystickClose(dev->joy);
+		dev->instanceID = -1;
+	}
+	if (daemon_socket_fd >= 0) {
+		close(daemon_socket_fd);
+		unlink(GAMEPAD_RING_SOCKET);
+		daemon_socket_fd = -1;
+	}
+	if (daemon_ring) {
+		GamepadRing_Shutdown(daemon_ring);
+		munmap(daemon_ring, sizeof(GamepadRing));
+		daemon_ring = NULL;
+	}
+	if (daemon_shm_fd >= 0) {
+		close(daemon_shm_fd);
+		shm_unlink(GAMEPAD_RING_SHM_NAME);
+		daemon_shm_fd = -1;
+	}
+	if (daemon_lock_fd >= 0) {
+		close(daemon_lock_fd);
+		daemon_lock_fd = -1;
+	}
+}
 
-void SDL2_Init_Haptic_From_Joystick(void)
+DaemonDevice *SDL2_Daemon_Find_Device(SDL_JoystickID id)
 {
-    // Test for haptic num_devices
-    // Mouses may have haptics, and not the joystick we are testing.
-    printf("Sys_InitInput: %d haptic devices detected.\n", SDL_NumHaptics());
+	int i;
 
-    // Try to open haptic from used joystick
-    if (joy) {
-        if (SDL_JoystickIsHaptic(joy)) {
-			haptic = SDL_HapticOpenFromJoystick( joy );
-			if( haptic == NULL ) {
-				printf( "SDL_HapticOpenFromJoystick() failed: %s\n", SDL_GetError() );
+	for (i = 0; i < DAEMON_MAX_DEVICES; i++) {
+		if (daemon_devices[i].instanceID >= 0 && daemon_devices[i].instanceID == id)
+			return &daemon_devices[i];
+	}
+
+	return NULL;
+}
+
+void SDL2_Daemon_Open_Device(int device_index)
+{
+	DaemonDevice *dev = NULL;
+	int i;
+
+	for (i = 0; i < DAEMON_MAX_DEVICES; i++) {
+		if (daemon_devices[i].instanceID < 0) {
+			dev = &daemon_devices[i];
+			break;
+		}
+	}
+	if (!dev) {
+		printf("Daemon: too many devices, ignoring device index %i\n", device_index);
+		return;
+	}
+
+	// SDL sends SDL_CONTROLLERDEVICEADDED and SDL_JOYDEVICEADDED for game
+	// controllers. Devices are only opened here, on the joystick event.
+	dev->gamepad = NULL;
+	if (SDL_IsGameController(device_index))
+		dev->gamepad = SDL_GameControllerOpen(device_index);
+	if (dev->gamepad)
+		dev->joy = SDL_GameControllerGetJoystick(dev->gamepad);
+	else
+		dev->joy = SDL_JoystickOpen(device_index);
+	if (!dev->joy) {
+		printf("Daemon: SDL_JoystickOpen() failed: %s\n", SDL_GetError());
+		return;
+	}
+	if (SDL2_Daemon_Find_Device(SDL_JoystickInstanceID(dev->joy))) {
+		// Already open. SDL_JoystickOpen() only incremented the ref count.
+		if (dev->gamepad)
+			SDL_GameControllerClose(dev->gamepad);
+		else
+			SDL_JoystickClose(dev->joy);
+		return;
+	}
+	dev->instanceID = SDL_JoystickInstanceID(dev->joy);
+	SDL_JoystickGetGUIDString(SDL_JoystickGetGUID(dev->joy), dev->guid, sizeof(dev->guid));
+
+	dev->haptic = NULL;
+	if (SDL_JoystickIsHaptic(dev->joy)) {
+		dev->haptic = SDL_HapticOpenFromJoystick(dev->joy);
+		if (dev->haptic && (SDL_HapticRumbleSupported(dev->haptic) == SDL_FALSE ||
+		                    SDL_HapticRumbleInit(dev->haptic) != 0)) {
+			SDL_HapticClose(dev->haptic);
+			dev->haptic = NULL;
+		}
+	}
+
+	printf("Daemon: opened %s %i (%s) instance id %i%s\n",
+	       dev->gamepad ? "gamepad" : "joystick", device_index,
+	       SDL_JoystickName(dev->joy), dev->instanceID, dev->haptic ? " with rumble" : "");
+}
+
+void SDL2_Daemon_Close_Device(SDL_JoystickID id)
+{
+	DaemonDevice *dev = SDL2_Daemon_Find_Device(id);
+
+	if (!dev)
+		return;
+	printf("Daemon: closing instance id %i\n", id);
+	if (dev->haptic)
+		SDL_HapticClose(dev->haptic);
+	if (dev->gamepad)
+		SDL_GameControllerClose(dev->gamepad);
+	else
+		SDL_JoystickClose(dev->joy);
+	dev->haptic = NULL;
+	dev->gamepad = NULL;
+	dev->joy = NULL;
+	dev->instanceID = -1;
+}
+
+int SDL2_Daemon_Rumble(SDL_JoystickID id, int strength, Uint32 length_ms)
+{
+	DaemonDevice *dev = SDL2_Daemon_Find_Device(id);
+
+	if (!dev)
+		return -1;
+	if (strength < 0)
+		strength = 0;
+	if (strength > 100)
+		strength = 100;
+	if (dev->haptic)
+		return SDL_HapticRumblePlay(dev->haptic, strength / 100.0f, length_ms);
+#if SDL_VERSION_ATLEAST(2, 0, 9)
+	Uint16 magnitude = (Uint16)(0xFFFF * strength / 100);
+	return SDL_JoystickRumble(dev->joy, magnitude, magnitude, length_ms);
+#else
+	return -1;
+#endif
+}
+
+// Run one control command and store the reply.
+void SDL2_Daemon_Command(const char *cmd, char *reply, int reply_size)
+{
+	int i;
+
+	reply[0] = '\0';
+	if (strncmp(cmd, "list", 4) == 0) {
+		for (i = 0; i < DAEMON_MAX_DEVICES; i++) {
+			DaemonDevice *dev = &daemon_devices[i];
+			char line[512];
+
+			if (dev->instanceID < 0)
+				continue;
+			SDL_snprintf(line, sizeof(line), "%i %i %i %s %s\n",
+			             dev->instanceID, dev->gamepad ? 1 : 0, dev->haptic ? 1 : 0,
+			             dev->guid, SDL_JoystickName(dev->joy));
+			SDL_strlcat(reply, line, reply_size);
+		}
+		SDL_strlcat(reply, "end\n", reply_size);
+	} else if (strncmp(cmd, "subscribe", 9) == 0) {
+		// Subscription is a filter applied by the client on the broadcast
+		// ring. The daemon only checks the device and hands out the cursor.
+		int id = -1;
+
+		if (sscanf(cmd + 9, "%i", &id) == 1 && !SDL2_Daemon_Find_Device(id)) {
+			SDL_snprintf(reply, reply_size, "error unknown instance %i\n", id);
+		} else {
+			SDL_snprintf(reply, reply_size, "ok %llu\n",
+			             (unsigned long long)__atomic_load_n(&daemon_ring->write_seq, __ATOMIC_ACQUIRE));
+		}
+	} else if (strncmp(cmd, "rumble", 6) == 0) {
+		int id, strength, length_ms;
+
+		if (sscanf(cmd + 6, "%i %i %i", &id, &strength, &length_ms) != 3) {
+			SDL_snprintf(reply, reply_size, "error usage: rumble <instance> <0-100> <ms>\n");
+		} else if (SDL2_Daemon_Rumble(id, strength, length_ms) != 0) {
+			SDL_snprintf(reply, reply_size, "error rumble failed on instance %i\n", id);
+		} else {
+			SDL_snprintf(reply, reply_size, "ok\n");
+		}
+	} else {
+		SDL_snprintf(reply, reply_size, "error unknown command\n");
+	}
+}
+
+// Serve pending control connections, one command per connection. Commands
+// are read without blocking, so a slow or idle client never stalls the event
+// publishing.
+void SDL2_Daemon_Service_Socket(void)
+{
+	char reply[4096];
+	int client_fd, len, i;
+
+	while ((client_fd = accept(daemon_socket_fd, NULL, NULL)) >= 0) {
+		DaemonClient *c = NULL;
+
+		for (i = 0; i < DAEMON_MAX_CLIENTS; i++) {
+			if (daemon_clients[i].fd < 0) {
+				c = &daemon_clients[i];
+				break;
+			}
+		}
+		if (!c) {
+			close(client_fd);
+			continue;
+		}
+		fcntl(client_fd, F_SETFL, O_NONBLOCK);
+		c->fd = client_fd;
+		c->accept_ticks = SDL_GetTicks();
+		c->len = 0;
+	}
+
+	for (i = 0; i < DAEMON_MAX_CLIENTS; i++) {
+		DaemonClient *c = &daemon_clients[i];
+
+		if (c->fd < 0)
+			continue;
+		len = recv(c->fd, c->cmd + c->len, sizeof(c->cmd) - 1 - c->len, 0);
+		if (len > 0) {
+			c->len += len;
+			c->cmd[c->len] = '\0';
+		} else if (len == 0 || (errno != EAGAIN && errno != EWOULDBLOCK) ||
+		           SDL_GetTicks() - c->accept_ticks > DAEMON_CLIENT_TIMEOUT_MS) {
+			close(c->fd);
+			c->fd = -1;
+			continue;
+		}
+		// Wait for the rest of the command
+		if (!memchr(c->cmd, '\n', c->len) && c->len < (int)sizeof(c->cmd) - 1)
+			continue;
+
+		SDL2_Daemon_Command(c->cmd, reply, sizeof(reply));
+		send(c->fd, reply, SDL_strlen(reply), MSG_NOSIGNAL);
+		close(c->fd);
+		c->fd = -1;
+	}
+}
+
+void SDL2_Daemon_Run(void)
+{
+	SDL_Event ev;
+	int run_loop = 1;
+
+	printf("Daemon: waiting for joystick events. Press CTRL+C to exit.\n");
+	fflush(stdout);
+	while (run_loop) {
+		__atomic_store_n(&daemon_ring->heartbeat, daemon_ring->heartbeat + 1, __ATOMIC_RELEASE);
+		SDL2_Daemon_Service_Socket();
+
+		// Short timeout so control commands are answered promptly
+		if (!SDL_WaitEventTimeout(&ev, 10))
+			continue;
+
+		switch (ev.type) {
+			case SDL_JOYDEVICEADDED:
+				SDL2_Daemon_Open_Device(ev.jdevice.which);
+				break;
+			case SDL_JOYDEVICEREMOVED:
+				SDL2_Daemon_Close_Device(ev.jdevice.which);
+				break;
+			case SDL_QUIT:
+				run_loop = 0;
+				break;
+		}
+
+		// Publish everything joystick and controller related, hotplug and
+		// controller touchpad/sensor events included. SDL_FINGERDOWN starts
+		// the touch events that follow the controller events.
+		if (ev.type >= SDL_JOYAXISMOTION && ev.type < SDL_FINGERDOWN)
+			GamepadRing_Write(daemon_ring, &ev);
+
+		fflush(stdout);
+	}
+	printf("Daemon: %llu events published\n",
+	       (unsigned long long)(daemon_ring->write_seq - 1));
+}
+#endif
+
+//
+// Structured output of the input events (axes, buttons and hats).
+// Records are formatted with std::to_chars into one reusable buffer with
+// precomputed name tables, and written in large blocks: when the buffer fills
+// up and when the event queue is empty. Nothing is allocated per event.
+//
+// JSON Lines and CSV use the fields t,type,dev,index,name,value,shaped.
+// Binary is the "SJTBIN01" magic and a Uint32 record size, followed by
+// OutputRecord structures in native byte order.
+// The OUTPUT_* formats are in test_gamepad_SDL2.h.
+//
+#define OUTPUT_BUFFER_SIZE 65536
+#define OUTPUT_RECORD_MAX  256   // Longest formatted record
+
+typedef struct OutputRecord
+{
+	Uint32 timestamp;
+	Sint32 which;   // Joystick instance id
+	Uint16 type;    // SDL event type
+	Uint8 index;    // Axis, button or hat number
+	Uint8 padding;
+	Sint16 value;   // Axis value, button state or hat value
+	Sint16 shaped;  // Response curve output, same as value without a curve
+}OutputRecord;
+SDL_COMPILE_TIME_ASSERT(output_record, sizeof(OutputRecord) == 16);
+
+typedef struct OutputName
+{
+	const char *str;
+	size_t len;
+}OutputName;
+
+int SDL_output_format = OUTPUT_TEXT;
+FILE *output_stream = NULL;
+char output_buffer[OUTPUT_BUFFER_SIZE];
+size_t output_len = 0;
+OutputName output_axis_names[SDL_CONTROLLER_AXIS_MAX];
+OutputName output_button_names[SDL_CONTROLLER_BUTTON_MAX];
+
+void SDL2_Output_Flush(void)
+{
+	if (output_len) {
+		fwrite(output_buffer, 1, output_len, output_stream);
+		output_len = 0;
+	}
+	fflush(output_stream);
+}
+
+static inline void SDL2_Output_Str(const char *str, size_t len)
+{
+	SDL_memcpy(output_buffer + output_len, str, len);
+	output_len += len;
+}
+
+static inline void SDL2_Output_Int(Sint64 v)
+{
+	output_len = std::to_chars(output_buffer + output_len, output_buffer + OUTPUT_BUFFER_SIZE, v).ptr - output_buffer;
+}
+
+#define SDL2_OUTPUT_LITERAL(s) SDL2_Output_Str(s, sizeof(s) - 1)
+
+void SDL2_Output_Init(int format, FILE *stream)
+{
+	int i;
+
+	SDL_output_format = format;
+	output_stream = stream;
+	output_len = 0;
+	for (i = 0; i < SDL_CONTROLLER_AXIS_MAX; i++) {
+		output_axis_names[i].str = SDL_GameControllerGetStringForAxis((SDL_GameControllerAxis)i);
+		if (!output_axis_names[i].str)
+			output_axis_names[i].str = "";
+		output_axis_names[i].len = SDL_strlen(output_axis_names[i].str);
+	}
+	for (i = 0; i < SDL_CONTROLLER_BUTTON_MAX; i++) {
+		output_button_names[i].str = SDL_GameControllerGetStringForButton((SDL_GameControllerButton)i);
+		if (!output_button_names[i].str)
+			output_button_names[i].str = "";
+		output_button_names[i].len = SDL_strlen(output_button_names[i].str);
+	}
+
+	if (format == OUTPUT_CSV) {
+		SDL2_OUTPUT_LITERAL("t,type,dev,index,name,value,shaped\n");
+	} else if (format == OUTPUT_BINARY) {
+		Uint32 record_size = sizeof(OutputRecord);
+
+		SDL2_OUTPUT_LITERAL("SJTBIN01");
+		SDL2_Output_Str((const char *)&record_size, sizeof(record_size));
+	}
+}
+
+// Returns 1 if the event is an input event handled here, 0 otherwise.
+int SDL2_Output_Event(const SDL_Event *ev)
+{
+	OutputRecord rec;
+	const OutputName *name = NULL;
+	const Sint16 *lut = NULL;
+	const char *type;
+	size_t type_len;
+
+	switch (ev->type) {
+		case SDL_JOYAXISMOTION:
+			if (!SDL2_Dead_Zone_Passes(ev->jaxis.value))
+				return 1;
+			type = "jaxis"; type_len = 5;
+			rec.index = ev->jaxis.axis;
+			rec.value = ev->jaxis.value;
+			lut = SDL_stick_lut;
+			break;
+		case SDL_JOYBUTTONDOWN:
+		case SDL_JOYBUTTONUP:
+			type = "jbutton"; type_len = 7;
+			rec.index = ev->jbutton.button;
+			rec.value = ev->jbutton.state;
+			break;
+		case SDL_JOYHATMOTION:
+			type = "jhat"; type_len = 4;
+			rec.index = ev->jhat.hat;
+			rec.value = ev->jhat.value;
+			break;
+		case SDL_CONTROLLERAXISMOTION:
+			if (!SDL2_Dead_Zone_Passes(ev->caxis.value))
+				return 1;
+			type = "caxis"; type_len = 5;
+			rec.index = ev->caxis.axis;
+			rec.value = ev->caxis.value;
+			if (rec.index < SDL_CONTROLLER_AXIS_MAX)
+				name = &output_axis_names[rec.index];
+			lut = rec.index >= SDL_CONTROLLER_AXIS_TRIGGERLEFT ? SDL_trigger_lut : SDL_stick_lut;
+			break;
+		case SDL_CONTROLLERBUTTONDOWN:
+		case SDL_CONTROLLERBUTTONUP:
+			type = "cbutton"; type_len = 7;
+			rec.index = ev->cbutton.button;
+			rec.value = ev->cbutton.state;
+			if (rec.index < SDL_CONTROLLER_BUTTON_MAX)
+				name = &output_button_names[rec.index];
+			break;
+		default:
+			return 0;
+	}
+	rec.timestamp = ev->common.timestamp;
+	rec.which = ev->jaxis.which; // Same offset in all input events
+	rec.type = (Uint16)ev->type;
+	rec.padding = 0;
+	rec.shaped = lut ? SDL2_Curve_Lookup(lut, rec.value) : rec.value;
+
+	if (output_len + OUTPUT_RECORD_MAX > OUTPUT_BUFFER_SIZE)
+		SDL2_Output_Flush();
+
+	if (SDL_output_format == OUTPUT_BINARY) {
+		SDL2_Output_Str((const char *)&rec, sizeof(rec));
+	} else if (SDL_output_format == OUTPUT_JSONL) {
+		SDL2_OUTPUT_LITERAL("{\"t\":");
+		SDL2_Output_Int(rec.timestamp);
+		SDL2_OUTPUT_LITERAL(",\"type\":\"");
+		SDL2_Output_Str(type, type_len);
+		SDL2_OUTPUT_LITERAL("\",\"dev\":");
+		SDL2_Output_Int(rec.which);
+		SDL2_OUTPUT_LITERAL(",\"index\":");
+		SDL2_Output_Int(rec.index);
+		SDL2_OUTPUT_LITERAL(",\"name\":\"");
+		if (name)
+			SDL2_Output_Str(name->str, name->len);
+		SDL2_OUTPUT_LITERAL("\",\"value\":");
+		SDL2_Output_Int(rec.value);
+		SDL2_OUTPUT_LITERAL(",\"shaped\":");
+		SDL2_Output_Int(rec.shaped);
+		SDL2_OUTPUT_LITERAL("}\n");
+	} else {
+		SDL2_Output_Int(rec.timestamp);
+		SDL2_OUTPUT_LITERAL(",");
+		SDL2_Output_Str(type, type_len);
+		SDL2_OUTPUT_LITERAL(",");
+		SDL2_Output_Int(rec.which);
+		SDL2_OUTPUT_LITERAL(",");
+		SDL2_Output_Int(rec.index);
+		SDL2_OUTPUT_LITERAL(",");
+		if (name)
+			SDL2_Output_Str(name->str, name->len);
+		SDL2_OUTPUT_LITERAL(",");
+		SDL2_Output_Int(rec.value);
+		SDL2_OUTPUT_LITERAL(",");
+		SDL2_Output_Int(rec.shaped);
+		SDL2_OUTPUT_LITERAL("\n");
+	}
+
+	return 1;
+}
+
+// Print one event and act on hotplug events. This is the main loop switch,
+// returns 0 when the program must exit.
+int SDL2_Process_Event(const SDL_Event *ev)
+{
+	int run_loop = 1;
+
+	if (ev->type == SDL_JOYAXISMOTION)
+		SDL2_Device_Cache_Calibrate(&ev->jaxis);
+	if (SDL_output_format != OUTPUT_TEXT && SDL2_Output_Event(ev))
+		return run_loop;
+
+	switch( ev->type ) {
+		// SDL joystick API events /////////////////////////////////////////////////////////
+		case SDL_JOYAXISMOTION:
+			// NOTE: jaxis.which is the SDL_JoystickID, not the device index!!!
+			if( SDL2_Dead_Zone_Passes(ev->jaxis.value) ) {
+				printf("Joystick   %02i axis %02i value %i", 
+							 ev->jaxis.which, ev->jaxis.axis, ev->jaxis.value);
+				// The joystick API does not tell sticks from triggers
+				if (SDL_stick_lut)
+					printf(" shaped %i", SDL2_Curve_Lookup(SDL_stick_lut, ev->jaxis.value));
+				printf("\n");
+			}
+			break;
+
+		case SDL_JOYBUTTONDOWN:
+		case SDL_JOYBUTTONUP:
+			// NOTE: jbutton.which is the SDL_JoystickID, not the device index!!!
+			printf("Joystick   %02i button %02i state %i\n", 
+						 ev->jbutton.which, ev->jbutton.button, ev->jbutton.state);
+			break;
+			
+		case SDL_JOYHATMOTION:
+			// NOTE: jhat.which is the SDL_JoystickID, not the device index!!!
+			printf("Joystick   %02i hat %02i state ", ev->jhat.which, ev->jhat.hat);
+			if( ev->jhat.value & SDL_HAT_UP )
+				printf("SDL_HAT_UP ");
+			if( ev->jhat.value & SDL_HAT_RIGHT )
+				printf("SDL_HAT_RIGHT ");
+			if( ev->jhat.value & SDL_HAT_DOWN )
+				printf("SDL_HAT_DOWN ");
+			if( ev->jhat.value & SDL_HAT_LEFT )
+				printf("SDL_HAT_LEFT ");
+			if( ev->jhat.value == SDL_HAT_CENTERED )
+				printf("SDL_HAT_CENTERED ");
+			printf("\n");
+			break;
+
+		// SDL2 joystick hotplug events
+		case SDL_JOYDEVICEADDED:
+			// WARNING: which is the joystick device index for the SDL_CONTROLLERDEVICEADDED event 
+			// but it is the instance id for the SDL_CONTROLLERDEVICEREMOVED 
+			// or SDL_CONTROLLERDEVICEREMAPPED event.
+			printf("SDL_JOYDEVICEADDED jdevice.which %02i (%s) [DEVICE INDEX]\n", 
+						 ev->jdevice.which, SDL_JoystickNameForIndex(ev->jdevice.which));
+#ifdef __SDL2_ENABLE_CONTROLLER_HOTPLUG
+			if( gamepad ) {
+				// If a valid controller is already opened do nothing
+				printf( " Gamepad %02i (%s) in use\n", 
+								                  device_index_in_use, SDL_GameControllerNameForIndex(device_index_in_use));
+				printf( " Ignoring plugged-in joystick device number %02i (%s)\n", 
+								ev->jdevice.which, SDL_JoystickNameForIndex(ev->jdevice.which));
+			} else if( joy ) {
+				// If a valid joystick is already opened do nothing
+				printf( " Joystick %02i (%s) in use\n", 
+								                  device_index_in_use, SDL_JoystickNameForIndex(device_index_in_use));
+				printf( " Ignoring plugged-in joystick device number %02i (%s)\n", 
+								ev->jdevice.which, SDL_JoystickNameForIndex(ev->jdevice.which));
 			} else {
-				if( SDL_HapticRumbleSupported(haptic) == SDL_FALSE) {
-					printf( "WARNING: Rumble not supported!\n");
-					SDL_HapticClose(haptic);
+				int gamepad_idx_to_open = ev->jdevice.which;
+
+				// Open joystick for use
+				SDL_joystick_is_gamepad = 0;
+				// If fails open joystick as joystick (old SDL joystick API)
+				printf("Opening joystick with joystick API\n");
+				printf( " Device %02i %s a game controller\n", 
+							  gamepad_idx_to_open, SDL_IsGameController(gamepad_idx_to_open) ? "is" : "is not" );
+
+				SDL_device_open_start = SDL_GetPerformanceCounter();
+				joy = SDL_JoystickOpen( gamepad_idx_to_open );
+				if (joy == NULL ) {
+					SDL2_Device_Printf( "SDL_JoystickOpen failed: %s\n", SDL_GetError() );
+					SDL2_Device_Printf( "Couldn't open joystick %i\n", gamepad_idx_to_open );
+					joy = NULL;
+					instanceID = -1;
+					device_index_in_use = -1;
+				} else {
+					instanceID = SDL_JoystickInstanceID(joy);
+					device_index_in_use = gamepad_idx_to_open;
+					SDL2_Device_Cache_Opened(device_index_in_use);
+				}
+			}
+#endif
+			// Start haptic from opened joystick
+			SDL2_Init_Haptic_From_Joystick();
+			SDL2_Device_Cache_Account();
+			break;
+
+		case SDL_JOYDEVICEREMOVED:
+			// WARNING: which is the joystick device index for the SDL_CONTROLLERDEVICEADDED event 
+			// but it is the instance id for the SDL_CONTROLLERDEVICEREMOVED 
+			// or SDL_CONTROLLERDEVICEREMAPPED event.
+			printf("SDL_JOYDEVICEREMOVED jdevice.which %02i [INSTANCE ID]\n", ev->jdevice.which);
+#ifdef __SDL2_ENABLE_CONTROLLER_HOTPLUG
+			if( joy && instanceID == ev->jdevice.which ) {
+				// If a joystick is in use opened check if the user unplugged it
+				printf(" Joystick device number %02i in use was unplugged. Closing it\n", device_index_in_use );
+				if (haptic) {
+					SDL_HapticClose( haptic );
 					haptic = NULL;
+				}
+				SDL2_Device_Cache_Closed();
+				SDL_JoystickClose( joy );
+				joy = NULL;
+				instanceID = -1;
+				device_index_in_use = -1;
+			} else {
+				// If not in use do nothing
+				printf( " Unplugged joystick %02i not in use. Doing nothing\n", ev->jdevice.which );
+			}
+#endif
+			break;
+			
+		// SDL controller API events ///////////////////////////////////////////////////////
+		case SDL_CONTROLLERAXISMOTION:
+			if( SDL2_Dead_Zone_Passes(ev->caxis.value) ) {
+				const Sint16 *lut = ev->caxis.axis >= SDL_CONTROLLER_AXIS_TRIGGERLEFT ? SDL_trigger_lut : SDL_stick_lut;
+
+				printf("Controller %02i axis %02i value %02i axis name %s", 
+							ev->caxis.which, ev->caxis.axis, ev->caxis.value,
+							SDL_GameControllerGetStringForAxis((SDL_GameControllerAxis)ev->caxis.axis) );
+				if (lut)
+					printf(" shaped %i", SDL2_Curve_Lookup(lut, ev->caxis.value));
+				printf("\n");
+			}
+			break;
+
+		case SDL_CONTROLLERBUTTONDOWN:
+		case SDL_CONTROLLERBUTTONUP:
+			printf("Controller %02i button %02i state %i button name %s\n", 
+						 ev->cbutton.which, ev->cbutton.button, ev->cbutton.state, 
+						 SDL_GameControllerGetStringForButton((SDL_GameControllerButton)ev->cbutton.button) );
+			break;
+			
+		case SDL_CONTROLLERDEVICEADDED:
+			// WARNING: which is the joystick device index for the SDL_CONTROLLERDEVICEADDED event 
+			// but it is the instance id for the SDL_CONTROLLERDEVICEREMOVED 
+			// or SDL_CONTROLLERDEVICEREMAPPED event.
+			printf("SDL_CONTROLLERDEVICEADDED cdevice.which %02i (%s) [DEVICE INDEX]\n", 
+						 ev->cdevice.which, SDL_GameControllerNameForIndex(ev->cdevice.which));
+#ifdef __SDL2_ENABLE_CONTROLLER_HOTPLUG
+			if( gamepad ) { 
+				// If a valid controller is already opened do nothing
+				printf( " Gamepad %02i (%s) already in use\n", 
+								device_index_in_use, SDL_GameControllerNameForIndex(device_index_in_use));
+				printf( " Ignoring plugged-in gamepad %02i (%s)\n", 
+								ev->cdevice.which, SDL_GameControllerNameForIndex(ev->cdevice.which) );
+			} else {
+				int gamepad_idx_to_open = ev->cdevice.which;
+			
+				// Open and start using the newly connected device
+				SDL_device_open_start = SDL_GetPerformanceCounter();
+				gamepad = SDL_GameControllerOpen( gamepad_idx_to_open );
+				if( gamepad == NULL ) {
+					// If fails open joystick as joystick (old SDL joystick API)
+					SDL2_Device_Printf(" SDL_GameControllerOpen failed: %s\n", SDL_GetError());
+					SDL2_Device_Printf(" Opening joystick with old SDL joystick API\n");
+					SDL_joystick_is_gamepad = 0;
+					// Don't try to open the gamepad as a joystick
+					// If a controller is hotplugged two events are received, first a
+					// gamepad event and then a joystick event for the same device. 
+					// Open the joystick in the joystick plugged event and not here.
 				} else {
-					if (SDL_HapticRumbleInit(haptic) != 0) {
-						printf( "WARNING: to initialize rumble: %s\n", SDL_GetError());
-						SDL_HapticClose(haptic);
-						haptic = NULL;
-					} else {
-						printf( "Sys_InitInput: Rumble initialization OK\n");
-					}
+					SDL_joystick_is_gamepad = 1;
+					joy = SDL_GameControllerGetJoystick( gamepad );
+					instanceID = SDL_JoystickInstanceID(joy);
+					device_index_in_use = gamepad_idx_to_open;
+					SDL2_Device_Cache_Opened(device_index_in_use);
 				}
 			}
-		} else {
-			printf("Joystick does not support haptics/rumble\n");
-			haptic = NULL;
-		}
+#endif
+			// Start haptic from opened joystick
+			SDL2_Init_Haptic_From_Joystick();
+#ifdef __SDL2_ENABLE_SENSORS
+			SDL2_Init_Sensors_From_Gamepad();
+#endif
+			SDL2_Device_Cache_Account();
+			break;
+
+		case SDL_CONTROLLERDEVICEREMOVED:
+			// WARNING: which is the joystick device index for the SDL_CONTROLLERDEVICEADDED event 
+			// but it is the instance id for the SDL_CONTROLLERDEVICEREMOVED 
+			// or SDL_CONTROLLERDEVICEREMAPPED event.
+			printf("SDL_CONTROLLERDEVICEREMOVED cdevice.which %02i [INSTANCE ID]\n", ev->cdevice.which );
+#ifdef __SDL2_ENABLE_CONTROLLER_HOTPLUG
+			if( gamepad && instanceID == ev->cdevice.which) {
+				// If a gamepad is in use opened check if the user unplugged it
+				printf(" Gamepad %02i in use was unplugged. Closing it\n", device_index_in_use );
+				if (haptic) {
+					SDL_HapticClose( haptic );
+					haptic = NULL;
+				}
+				SDL2_Device_Cache_Closed();
+				SDL_GameControllerClose( gamepad );
+				gamepad = NULL;
+				// NOTE: what happens when a gamepad is closed? Is the joystick associated
+				// with this gamepad still valid?
+				// ANSWER: SDL_GameControllerClose() calls SDL_JoystickClose() internally
+				joy = NULL;
+				instanceID = -1;
+				device_index_in_use = -1;
+			} else {
+				// If not in use do nothing
+				printf( " Unplugged gamepad %02i not in use\n. Doing nothing\n", ev->cdevice.which );
+			}
+#endif
+			break;
+			
+#ifdef __SDL2_ENABLE_SENSORS
+		case SDL_CONTROLLERSENSORUPDATE:
+			SDL2_Sensor_Update(&ev->csensor);
+			break;
+#endif
+
+		case SDL_CONTROLLERDEVICEREMAPPED:
+			// WARNING: which is the joystick device index for the SDL_CONTROLLERDEVICEADDED event 
+			// but it is the instance id for the SDL_CONTROLLERDEVICEREMOVED 
+			// or SDL_CONTROLLERDEVICEREMAPPED event.
+			printf("SDL_CONTROLLERDEVICEREMAPPED cdevice.which %02i [INSTANCE ID]\n", ev->cdevice.which);
+			// Mappings have changed, cached ones are probed again when used
+			SDL2_Device_Cache_Invalidate_Mappings();
+			if( SDL_device_cache_current && instanceID == ev->cdevice.which ) {
+				SDL2_Device_Cache_Probe_Mapping(SDL_device_cache_current, device_index_in_use);
+				printf(" Gamepad %02i in use remapped: %s\n", device_index_in_use, SDL_device_cache_current->mapping);
+			}
+			break;
+			
+		case SDL_KEYDOWN:
+			printf("SDL_KEYDOWN: SDL_QUIT\n");
+			if (ev->key.keysym.sym == SDLK_ESCAPE)
+				run_loop = 0;
+			break;
+			
+		case SDL_QUIT:
+			printf( "SDL_QUIT\n" );
+			run_loop = 0;
+			break;
+		
+		default:
+			// Flood events are accounted in SDL2_Queue_Received()
+			if (SDL_queue_flood_type && ev->type == SDL_queue_flood_type)
+				break;
+			printf( "Sys_GetEvent: unknown SDL event %u\n", ev->type );
+			break;
 	}
+
+	return run_loop;
 }
 
+// bench_gamepad_SDL2 links this file without main()
+#ifndef __SDLJOYTEST_NO_MAIN
 int main(int argn, char** argv)
 {
     int numJoysticks, i;
     bool skipLoop = false;
+    bool daemonMode = false;
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    float replay_speed = 0;
+    int output_format = OUTPUT_TEXT;
 
     SDL_version compiled;
     SDL_version linked;
 
-    if (argn > 1 && strncmp(argv[1], "-skip_loop", 10) == 0) {
-      skipLoop = true;
+    for (i = 1; i < argn; i++) {
+        if (strncmp(argv[i], "-skip_loop", 10) == 0) {
+            skipLoop = true;
+        } else if (strcmp(argv[i], "-loop") == 0 && i + 1 < argn) {
+            i++;
+            if (strcmp(argv[i], "wait") == 0) {
+                SDL_loop_mode = LOOP_MODE_WAIT;
+            } else if (strcmp(argv[i], "poll") == 0) {
+                SDL_loop_mode = LOOP_MODE_POLL;
+            } else if (strcmp(argv[i], "hybrid") == 0) {
+                SDL_loop_mode = LOOP_MODE_HYBRID;
+            } else {
+                printf("Unknown loop mode '%s'\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-hybrid_busy_ms") == 0 && i + 1 < argn) {
+            SDL_hybrid_busy_ms = SDL_atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-hybrid_backoff_ms") == 0 && i + 1 < argn) {
+            SDL_hybrid_backoff_ms = SDL_atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-hybrid_wait_ms") == 0 && i + 1 < argn) {
+            SDL_hybrid_wait_ms = SDL_atoi(argv[++i]);
+#ifdef __SDL2_ENABLE_DAEMON
+        } else if (strcmp(argv[i], "-daemon") == 0) {
+            daemonMode = true;
+#endif
+        } else if ((strcmp(argv[i], "-curve") == 0 || strcmp(argv[i], "-trigger_curve") == 0) && i + 1 < argn) {
+            CurveProfile *curve = strcmp(argv[i], "-curve") == 0 ? &SDL_stick_curve : &SDL_trigger_curve;
+
+            if (SDL2_Curve_Parse(argv[++i], curve) != 0) {
+                printf("Wrong curve '%s'\n", argv[i]);
+                return 1;
+            }
+            if (curve == &SDL_stick_curve)
+                SDL_stick_lut = SDL2_Curve_Acquire(curve);
+            else
+                SDL_trigger_lut = SDL2_Curve_Acquire(curve);
+        } else if (strcmp(argv[i], "-curve_bench") == 0) {
+            SDL2_Curve_Bench();
+            return 0;
+        } else if (strcmp(argv[i], "-device_cache") == 0 && i + 1 < argn) {
+            SDL_device_cache_path = argv[++i];
+        } else if (strcmp(argv[i], "-record") == 0 && i + 1 < argn) {
+            record_path = argv[++i];
+        } else if (strcmp(argv[i], "-replay") == 0 && i + 1 < argn) {
+            replay_path = argv[++i];
+        } else if (strcmp(argv[i], "-replay_speed") == 0 && i + 1 < argn) {
+            replay_speed = SDL_atof(argv[++i]);
+        } else if (strcmp(argv[i], "-output") == 0 && i + 1 < argn) {
+            i++;
+            if (strcmp(argv[i], "text") == 0) {
+                output_format = OUTPUT_TEXT;
+            } else if (strcmp(argv[i], "jsonl") == 0) {
+                output_format = OUTPUT_JSONL;
+            } else if (strcmp(argv[i], "csv") == 0) {
+                output_format = OUTPUT_CSV;
+            } else if (strcmp(argv[i], "binary") == 0) {
+                output_format = OUTPUT_BINARY;
+            } else {
+                printf("Unknown output format '%s'\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-queue_stats") == 0) {
+            SDL_queue_stats = 1;
+        } else if (strcmp(argv[i], "-queue_flood") == 0 && i + 1 < argn) {
+            SDL_queue_stats = 1;
+            SDL_queue_flood_count = SDL_atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-event_filter") == 0) {
+            SDL_queue_stats = 1;
+            SDL_queue_event_filter = 1;
+#ifdef __SDL2_ENABLE_SENSORS
+        } else if (strcmp(argv[i], "-sensors") == 0) {
+            SDL_sensor_mode = 1;
+        } else if (strcmp(argv[i], "-sensor_synthetic") == 0 && i + 1 < argn) {
+            SDL_sensor_mode = 1;
+            SDL_sensor_synthetic_hz = SDL_atoi(argv[++i]);
+#endif
+        } else {
+            printf("Unknown option '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+
+    // The event queue and the devices are not used when replaying
+    if (replay_path) {
+        const char *live_option = NULL;
+
+        if (daemonMode)
+            live_option = "-daemon";
+        else if (SDL_queue_stats)
+            live_option = "-queue_stats, -queue_flood and -event_filter";
+#ifdef __SDL2_ENABLE_SENSORS
+        else if (SDL_sensor_synthetic_hz > 0)
+            live_option = "-sensor_synthetic";
+#endif
+        if (live_option) {
+            printf("%s cannot be used with -replay\n", live_option);
+            return 1;
+        }
+    }
+
+    //
+    // Structured output goes to stdout. Every other message is moved to
+    // stderr so the data stream can be piped as is.
+    //
+    if (output_format != OUTPUT_TEXT) {
+        FILE *data = stdout;
+#if defined(__unix__)
+        data = fdopen(dup(fileno(stdout)), "wb");
+        dup2(fileno(stderr), fileno(stdout));
+#endif
+        SDL2_Output_Init(output_format, data);
     }
 
     SDL_VERSION(&compiled);
@@ -81,12 +2392,34 @@ int main(int argn, char** argv)
     // Very interesting. If video is initialised in SDL2 then only button 
     // UP events work! (Tested with a Logitech F710 wireless)!!!
     //
-    printf( "Sys_InitInput: SDL2 joystick subsystem init\n" );
-    if (SDL_Init(SDL_INIT_JOYSTICK | SDL_INIT_GAMECONTROLLER | SDL_INIT_HAPTIC)) {
-        printf( "Sys_InitInput: SDL_Init() failed: %s\n", SDL_GetError());
-        return 0;
+    // When replaying the recorded devices are not present. Only the event
+    // subsystem is needed and no device is opened.
+    //
+    if (replay_path) {
+        if (Replay_Open(&replay, replay_path, replay_speed) != 0) {
+            printf( "Sys_InitInput: cannot replay %s\n", replay_path);
+            return 1;
+        }
+        printf( "Sys_InitInput: replaying %s, recorded with %s (%s)\n",
+                replay_path, replay.header.name, replay.header.guid);
+        if (SDL_Init(SDL_INIT_EVENTS)) {
+            printf( "Sys_InitInput: SDL_Init() failed: %s\n", SDL_GetError());
+            return 0;
+        }
+    } else {
+        printf( "Sys_InitInput: SDL2 joystick subsystem init\n" );
+        if (SDL_Init(SDL_INIT_JOYSTICK | SDL_INIT_GAMECONTROLLER | SDL_INIT_HAPTIC)) {
+            printf( "Sys_InitInput: SDL_Init() failed: %s\n", SDL_GetError());
+            return 0;
+        }
     }
 
+    //
+    // Load the device cache of previous sessions
+    //
+    if (SDL_device_cache_path && !replay.file)
+        SDL2_Device_Cache_Load(SDL_device_cache_path);
+
     //
     // Load controller mappings
     //
@@ -98,13 +2431,29 @@ int main(int argn, char** argv)
 					printf( "Sys_InitInput: SDL_GameControllerAddMappingsFromFile() failed: %s\n", SDL_GetError());
 			} else {
 					printf( "Sys_InitInput: SDL_GameControllerAddMappingsFromFile() added %i controller maps\n", num_devices );
+					SDL2_Device_Cache_Invalidate_Mappings();
 			}
 		}
 
+#ifdef __SDL2_ENABLE_DAEMON
+    //
+    // Daemon mode takes over from here. Devices present at startup are
+    // reported by SDL as SDL_JOYDEVICEADDED events.
+    //
+    if (daemonMode) {
+        if (SDL2_Daemon_Init() == 0) {
+            SDL2_Daemon_Run();
+        }
+        SDL2_Daemon_Shutdown();
+        SDL_QuitSubSystem(SDL_INIT_JOYSTICK | SDL_INIT_GAMECONTROLLER | SDL_INIT_HAPTIC);
+        return 0;
+    }
+#endif
+
     //
     // Print joystick information at startup time.
     //
-    numJoysticks = SDL_NumJoysticks();
+    numJoysticks = replay.file ? 0 : SDL_NumJoysticks();
     printf( "Sys_InitInput: Joystick subsytem - Found %i joysticks at startup\n", numJoysticks);
     for (i = 0; i < numJoysticks; i++) {
         joy = SDL_JoystickOpen(i);
@@ -135,60 +2484,32 @@ int main(int argn, char** argv)
 		int gamepad_idx_to_open = SDL_wanted_joystick_number;
 		
 		// Try to open joystick as controller
+		SDL_device_open_start = SDL_GetPerformanceCounter();
 		gamepad = SDL_GameControllerOpen( gamepad_idx_to_open );
 		if( gamepad == NULL ) {
 			SDL_joystick_is_gamepad = 0;
 			// If fails open joystick as joystick (old SDL joystick API)
-			printf("SDL_GameControllerOpen failed: %s\n", SDL_GetError());
-			printf("Opening joystick with old SDL joystick API\n");
+			SDL2_Device_Printf("SDL_GameControllerOpen failed: %s\n", SDL_GetError());
+			SDL2_Device_Printf("Opening joystick with old SDL joystick API\n");
 
 			joy = SDL_JoystickOpen( gamepad_idx_to_open );
 			if (joy == NULL ) {
-				printf( "SDL_JoystickOpen failed: %s\n", SDL_GetError() );
-				printf( "Couldn't open joystick %i\n", gamepad_idx_to_open );
+				SDL2_Device_Printf( "SDL_JoystickOpen failed: %s\n", SDL_GetError() );
+				SDL2_Device_Printf( "Couldn't open joystick %i\n", gamepad_idx_to_open );
 				joy = NULL;
 				instanceID = -1;
 				device_index_in_use = -1;
 			} else {
-				int num_hats;
-				char guid[64];
-
 				instanceID = SDL_JoystickInstanceID(joy);
 				device_index_in_use = gamepad_idx_to_open;
-				SDL_JoystickGetGUIDString(SDL_JoystickGetGUID(joy), guid, sizeof (guid));
-				num_hats = SDL_JoystickNumHats( joy );
-				printf( "Opened joystick device index %i (%s)\n", 
-								                device_index_in_use, SDL_JoystickNameForIndex( device_index_in_use ) );
-				printf( "        axes: %d\n", SDL_JoystickNumAxes( joy ) );
-				printf( "     buttons: %d\n", SDL_JoystickNumButtons( joy ) );
-				printf( "        hats: %d\n", num_hats );
-				printf( "       balls: %d\n", SDL_JoystickNumBalls( joy ) );
-				printf( " instance id: %d\n", SDL_JoystickInstanceID( joy ) );
-				printf( "        guid: %s\n", guid);
-				
-				SDL_joystick_has_hat = 0;
-				if( num_hats )
-					SDL_joystick_has_hat = 1;
+				SDL2_Device_Cache_Opened(device_index_in_use);
 			}
 		} else {
 			SDL_joystick_is_gamepad = 1;
 			joy = SDL_GameControllerGetJoystick( gamepad );
 			instanceID = SDL_JoystickInstanceID(joy);
 			device_index_in_use = gamepad_idx_to_open;
-
-			// Remember that gamepads do not have hats in SDL2
-			int num_axes = 0;
-			int num_buttons = 0;
-			char guid[64];
-
-			SDL_JoystickGetGUIDString(SDL_JoystickGetGUID(joy), guid, sizeof (guid));
-			printf( "Opened gamepad device index %i (%s)\n", 
-							             device_index_in_use, SDL_GameControllerNameForIndex( device_index_in_use ) );
-			printf( "        axes: %d\n", SDL_JoystickNumAxes( joy ) );
-			printf( "     buttons: %d\n", SDL_JoystickNumButtons( joy ) );
-			printf( " instance id: %d\n", SDL_JoystickInstanceID( joy ) );
-			printf( "        guid: %s\n", guid);
-			printf( "     mapping: %s\n", SDL_GameControllerMapping( gamepad ));
+			SDL2_Device_Cache_Opened(device_index_in_use);
 		}
 	} else {
 		gamepad = NULL;
@@ -199,6 +2520,10 @@ int main(int argn, char** argv)
 
 	// Start haptic from opened joystick
 	SDL2_Init_Haptic_From_Joystick();
+#ifdef __SDL2_ENABLE_SENSORS
+	SDL2_Init_Sensors_From_Gamepad();
+#endif
+	SDL2_Device_Cache_Account();
 	
 	//
 	// If no joystick found then exit
@@ -213,248 +2538,84 @@ int main(int argn, char** argv)
 #ifdef __SDL2_ENABLE_CONTROLLER_HOTPLUG
 	printf("SDL2: Joytick hotplug supported\n");
 #endif
+	if (run_loop && record_path) {
+		char guid[64] = "";
+
+		if (joy)
+			SDL_JoystickGetGUIDString(SDL_JoystickGetGUID(joy), guid, sizeof (guid));
+		record_file = Replay_Record_Open(record_path, guid, joy ? SDL_JoystickName(joy) : "");
+		if (record_file)
+			printf("Recording events to %s\n", record_path);
+		else
+			printf("Cannot record to %s\n", record_path);
+	}
 	if (run_loop) {
 		printf("Waiting for joystick events. Press CTRL+C to exit.\n");
+		SDL2_Loop_Set_Phase(SDL_loop_mode == LOOP_MODE_POLL ? LOOP_PHASE_BUSY : LOOP_PHASE_IDLE);
+		if (SDL_queue_stats)
+			SDL2_Queue_Init();
+#ifdef __SDL2_ENABLE_SENSORS
+		if (SDL_sensor_synthetic_hz > 0) {
+			printf("Feeding synthetic sensor samples at %i Hz\n", SDL_sensor_synthetic_hz);
+			SDL_sensor_synthetic_timer = SDL_AddTimer(1, SDL2_Sensor_Synthetic_Callback, NULL);
+		}
+#endif
 	}
 
 	while(run_loop) {
 		// SDL_PollEvent() poll event returns inmediately if no events. It consuments 100% CPU!!!
 		// SDL_WaitEvent() waits until next event
-		if( SDL_WaitEvent( &ev ) ) {
-			switch( ev.type ) {
-				// SDL joystick API events /////////////////////////////////////////////////////////
-				case SDL_JOYAXISMOTION:
-					// NOTE: jaxis.which is the SDL_JoystickID, not the device index!!!
-					if( ev.jaxis.value > SDL_dead_zone || ev.jaxis.value < -SDL_dead_zone) {
-						printf("Joystick   %02i axis %02i value %i\n", 
-									 ev.jaxis.which, ev.jaxis.axis, ev.jaxis.value);
-					}
-					break;
-
-				case SDL_JOYBUTTONDOWN:
-				case SDL_JOYBUTTONUP:
-					// NOTE: jbutton.which is the SDL_JoystickID, not the device index!!!
-					printf("Joystick   %02i button %02i state %i\n", 
-								 ev.jbutton.which, ev.jbutton.button, ev.jbutton.state);
-					break;
-					
-				case SDL_JOYHATMOTION:
-					// NOTE: jhat.which is the SDL_JoystickID, not the device index!!!
-					printf("Joystick   %02i hat %02i state ", ev.jhat.which, ev.jhat.hat);
-					if( ev.jhat.value & SDL_HAT_UP )
-						printf("SDL_HAT_UP ");
-					if( ev.jhat.value & SDL_HAT_RIGHT )
-						printf("SDL_HAT_RIGHT ");
-					if( ev.jhat.value & SDL_HAT_DOWN )
-						printf("SDL_HAT_DOWN ");
-					if( ev.jhat.value & SDL_HAT_LEFT )
-						printf("SDL_HAT_LEFT ");
-					if( ev.jhat.value == SDL_HAT_CENTERED )
-						printf("SDL_HAT_CENTERED ");
-					printf("\n");
-					break;
-
-				// SDL2 joystick hotplug events
-				case SDL_JOYDEVICEADDED:
-					// WARNING: which is the joystick device index for the SDL_CONTROLLERDEVICEADDED event 
-					// but it is the instance id for the SDL_CONTROLLERDEVICEREMOVED 
-					// or SDL_CONTROLLERDEVICEREMAPPED event.
-					printf("SDL_JOYDEVICEADDED jdevice.which %02i (%s) [DEVICE INDEX]\n", 
-								 ev.jdevice.which, SDL_JoystickNameForIndex(ev.jdevice.which));
-#ifdef __SDL2_ENABLE_CONTROLLER_HOTPLUG
-					if( gamepad ) {
-						// If a valid controller is already opened do nothing
-						printf( " Gamepad %02i (%s) in use\n", 
-										                  device_index_in_use, SDL_GameControllerNameForIndex(device_index_in_use));
-						printf( " Ignoring plugged-in joystick device number %02i (%s)\n", 
-										ev.jdevice.which, SDL_JoystickNameForIndex(ev.jdevice.which));
-					} else if( joy ) {
-						// If a valid joystick is already opened do nothing
-						printf( " Joystick %02i (%s) in use\n", 
-										                  device_index_in_use, SDL_JoystickNameForIndex(device_index_in_use));
-						printf( " Ignoring plugged-in joystick device number %02i (%s)\n", 
-										ev.jdevice.which, SDL_JoystickNameForIndex(ev.jdevice.which));
-					} else {
-						int gamepad_idx_to_open = ev.jdevice.which;
-
-						// Open joystick for use
-						SDL_joystick_is_gamepad = 0;
-						// If fails open joystick as joystick (old SDL joystick API)
-						printf("Opening joystick with joystick API\n");
-						printf( " Device %02i %s a game controller\n", 
-									  gamepad_idx_to_open, SDL_IsGameController(gamepad_idx_to_open) ? "is" : "is not" );
-
-						joy = SDL_JoystickOpen( gamepad_idx_to_open );
-						if (joy == NULL ) {
-							printf( "SDL_JoystickOpen failed: %s\n", SDL_GetError() );
-							printf( "Couldn't open joystick %i\n", gamepad_idx_to_open );
-							joy = NULL;
-							instanceID = -1;
-							device_index_in_use = -1;
-						} else {
-							int num_hats;
-							char guid[64];
-
-							instanceID = SDL_JoystickInstanceID(joy);
-							device_index_in_use = gamepad_idx_to_open;
-							SDL_JoystickGetGUIDString(SDL_JoystickGetGUID(joy), guid, sizeof (guid));
-							num_hats = SDL_JoystickNumHats( joy );
-							printf( "Opened joystick device index %i (%s)\n", 
-											device_index_in_use, SDL_JoystickNameForIndex( device_index_in_use ) );
-							printf( "        axes: %d\n", SDL_JoystickNumAxes( joy ) );
-							printf( "     buttons: %d\n", SDL_JoystickNumButtons( joy ) );
-							printf( "        hats: %d\n", num_hats );
-							printf( "       balls: %d\n", SDL_JoystickNumBalls( joy ) );
-							printf( " instance id: %d\n", SDL_JoystickInstanceID( joy ) );
-							printf( "        guid: %s\n", guid);
-
-							SDL_joystick_has_hat = 0;
-							if( num_hats )
-								SDL_joystick_has_hat = 1;
-						}
-					}
-#endif
-					// Start haptic from opened joystick
-					SDL2_Init_Haptic_From_Joystick();
-					break;
-
-				case SDL_JOYDEVICEREMOVED:
-					// WARNING: which is the joystick device index for the SDL_CONTROLLERDEVICEADDED event 
-					// but it is the instance id for the SDL_CONTROLLERDEVICEREMOVED 
-					// or SDL_CONTROLLERDEVICEREMAPPED event.
-					printf("SDL_JOYDEVICEREMOVED jdevice.which %02i [INSTANCE ID]\n", ev.jdevice.which);
-#ifdef __SDL2_ENABLE_CONTROLLER_HOTPLUG
-					if( joy && instanceID == ev.jdevice.which ) {
-						// If a joystick is in use opened check if the user unplugged it
-						printf(" Joystick device number %02i in use was unplugged. Closing it\n", device_index_in_use );
-						SDL_JoystickClose( joy );
-						joy = NULL;
-						instanceID = -1;
-						device_index_in_use = -1;
-					} else {
-						// If not in use do nothing
-						printf( " Unplugged joystick %02i not in use. Doing nothing\n", ev.jdevice.which );
-					}
-#endif
-					break;
-					
-				// SDL controller API events ///////////////////////////////////////////////////////
-				case SDL_CONTROLLERAXISMOTION:
-					if( ev.caxis.value > SDL_dead_zone || ev.caxis.value < -SDL_dead_zone) {
-						printf("Controller %02i axis %02i value %02i axis name %s\n", 
-									ev.caxis.which, ev.caxis.axis, ev.caxis.value,
-									SDL_GameControllerGetStringForAxis((SDL_GameControllerAxis)ev.caxis.axis) );
-					}
-					break;
-
-				case SDL_CONTROLLERBUTTONDOWN:
-				case SDL_CONTROLLERBUTTONUP:
-					printf("Controller %02i button %02i state %i button name %s\n", 
-								 ev.cbutton.which, ev.cbutton.button, ev.cbutton.state, 
-								 SDL_GameControllerGetStringForButton((SDL_GameControllerButton)ev.cbutton.button) );
-					break;
-					
-				case SDL_CONTROLLERDEVICEADDED:
-					// WARNING: which is the joystick device index for the SDL_CONTROLLERDEVICEADDED event 
-					// but it is the instance id for the SDL_CONTROLLERDEVICEREMOVED 
-					// or SDL_CONTROLLERDEVICEREMAPPED event.
-					printf("SDL_CONTROLLERDEVICEADDED cdevice.which %02i (%s) [DEVICE INDEX]\n", 
-								 ev.cdevice.which, SDL_GameControllerNameForIndex(ev.cdevice.which));
-#ifdef __SDL2_ENABLE_CONTROLLER_HOTPLUG
-					if( gamepad ) { 
-						// If a valid controller is already opened do nothing
-						printf( " Gamepad %02i (%s) already in use\n", 
-										device_index_in_use, SDL_GameControllerNameForIndex(device_index_in_use));
-						printf( " Ignoring plugged-in gamepad %02i (%s)\n", 
-										ev.cdevice.which, SDL_GameControllerNameForIndex(ev.cdevice.which) );
-					} else {
-						int gamepad_idx_to_open = ev.cdevice.which;
-					
-						// Open and start using the newly connected device
-						gamepad = SDL_GameControllerOpen( gamepad_idx_to_open );
-						if( gamepad == NULL ) {
-							// If fails open joystick as joystick (old SDL joystick API)
-							printf(" SDL_GameControllerOpen failed: %s\n", SDL_GetError());
-							printf(" Opening joystick with old SDL joystick API\n");
-							SDL_joystick_is_gamepad = 0;
-							// Don't try to open the gamepad as a joystick
-							// If a controller is hotplugged two events are received, first a
-							// gamepad event and then a joystick event for the same device. 
-							// Open the joystick in the joystick plugged event and not here.
-						} else {
-							SDL_joystick_is_gamepad = 1;
-							joy = SDL_GameControllerGetJoystick( gamepad );
-							instanceID = SDL_JoystickInstanceID(joy);
-							device_index_in_use = gamepad_idx_to_open;
-
-							// Remember that gamepads do not have hats in SDL2
-							int num_axes = 0;
-							int num_buttons = 0;
-							char guid[64];
-
-							SDL_JoystickGetGUIDString(SDL_JoystickGetGUID(joy), guid, sizeof (guid));
-							printf( "Opened gamepad device index %i (%s)\n", 
-											gamepad_idx_to_open, SDL_GameControllerNameForIndex( gamepad_idx_to_open ) );
-							printf( "        axes: %d\n", SDL_JoystickNumAxes( joy ) );
-							printf( "     buttons: %d\n", SDL_JoystickNumButtons( joy ) );
-							printf( " instance id: %d\n", SDL_JoystickInstanceID( joy ) );
-							printf( "        guid: %s\n", guid);
-						}
-					}
-#endif
-					// Start haptic from opened joystick
-					SDL2_Init_Haptic_From_Joystick();
-					break;
-
-				case SDL_CONTROLLERDEVICEREMOVED:
-					// WARNING: which is the joystick device index for the SDL_CONTROLLERDEVICEADDED event 
-					// but it is the instance id for the SDL_CONTROLLERDEVICEREMOVED 
-					// or SDL_CONTROLLERDEVICEREMAPPED event.
-					printf("SDL_CONTROLLERDEVICEREMOVED cdevice.which %02i [INSTANCE ID]\n", ev.cdevice.which );
-#ifdef __SDL2_ENABLE_CONTROLLER_HOTPLUG
-					if( gamepad && instanceID == ev.cdevice.which) {
-						// If a gamepad is in use opened check if the user unplugged it
-						printf(" Gamepad %02i in use was unplugged. Closing it\n", device_index_in_use );
-						SDL_GameControllerClose( gamepad );
-						gamepad = NULL;
-						// NOTE: what happens when a gamepad is closed? Is the joystick associated
-						// with this gamepad still valid?
-						// ANSWER: SDL_GameControllerClose() calls SDL_JoystickClose() internally
-						joy = NULL;
-						instanceID = -1;
-						device_index_in_use = -1;
-					} else {
-						// If not in use do nothing
-						printf( " Unplugged gamepad %02i not in use\n. Doing nothing\n", ev.cdevice.which );
-					}
-#endif
-					break;
-					
-				case SDL_CONTROLLERDEVICEREMAPPED:
-					printf("SDL_CONTROLLERDEVICEREMAPPED \n");
-					printf("SDL event SDL_CONTROLLERDEVICEREMAPPED not implemented\n");
-					break;
-					
-				case SDL_KEYDOWN:
-					printf("SDL_KEYDOWN: SDL_QUIT\n");
-					if (ev.key.keysym.sym == SDLK_ESCAPE)
-						run_loop = 0;
-					break;
-					
-				case SDL_QUIT:
-					printf( "SDL_QUIT\n" );
-					run_loop = 0;
-					break;
-				
-				default:
-					printf( "Sys_GetEvent: unknown SDL event %u\n", ev.type );
-					break;
+		// SDL2_Loop_Get_Event() uses one of them, or both, depending on the loop mode.
+		// Replay_Wait_Event() reads the next recorded event.
+		if( replay.file ? Replay_Wait_Event( &replay, &ev, 0, 0 ) : SDL2_Loop_Get_Event( &ev ) ) {
+			if (record_file && ev.type != SDL_QUIT)
+				Replay_Record_Event(record_file, &ev);
+			if (SDL_queue_stats)
+				SDL2_Queue_Received(&ev);
+
+			if (replay.file && (ev.type == SDL_JOYDEVICEADDED || ev.type == SDL_JOYDEVICEREMOVED ||
+			                    ev.type == SDL_CONTROLLERDEVICEADDED || ev.type == SDL_CONTROLLERDEVICEREMOVED ||
+			                    ev.type == SDL_CONTROLLERDEVICEREMAPPED)) {
+				// Recorded hotplug. There is no device to open or close.
+				printf("Replay: device event %#06x which %02i\n", ev.type, ev.jdevice.which);
+				fflush(stdout);
+				continue;
 			}
+
+			if (!SDL2_Process_Event(&ev))
+				run_loop = 0;
 		}
 		
+		// Structured output is written in blocks, before waiting for more events
+		if (SDL_output_format != OUTPUT_TEXT && !replay.file && !SDL_HasEvents(SDL_FIRSTEVENT, SDL_LASTEVENT))
+			SDL2_Output_Flush();
 		fflush(stdout);
 	}
 
+	if (SDL_output_format != OUTPUT_TEXT)
+		SDL2_Output_Flush();
+
+	if (record_file) {
+		fclose(record_file);
+		record_file = NULL;
+	}
+	if (!skipLoop) {
+		// Loop timings are wall clock. Leave them out of replays so the output
+		// only depends on the recording.
+		if (!replay.file)
+			SDL2_Loop_Report();
+		if (SDL_queue_stats)
+			SDL2_Queue_Report();
+		if (!replay.file)
+			SDL2_Device_Cache_Report();
+#ifdef __SDL2_ENABLE_SENSORS
+		if (SDL_sensor_synthetic_timer)
+			SDL_RemoveTimer(SDL_sensor_synthetic_timer);
+		if (SDL_sensor_mode)
+			SDL2_Sensor_Report();
+#endif
+	}
+
     //
     // Close haptics
     //
@@ -485,6 +2646,12 @@ int main(int argn, char** argv)
 		printf( "Sys_ShutdownInput: SDL joystick not initialized. Nothing to close.\n" );
 	}
 
+    SDL2_Device_Cache_Closed();
+    if (SDL_device_cache_path && !replay.file)
+        SDL2_Device_Cache_Save(SDL_device_cache_path);
+    SDL2_Curve_Release_All();
+    Replay_Close(&replay);
+
     //
     // Shutdown SDL2
     //
@@ -492,3 +2659,4 @@ int main(int argn, char** argv)
 
     return 0;
 }
+#endif
@@ -0,0 +1,41 @@
+/*
+ * Declarations shared by test_gamepad_SDL2.cpp and bench_gamepad_SDL2.cpp.
+ * The benchmarks link test_gamepad_SDL2.cpp built with __SDLJOYTEST_NO_MAIN
+ * and measure its real code paths through these functions.
+ *
+ * (c) Wintermute0110 <wintermute0110@gmail.com> 2019
+ */
+#ifndef __TEST_GAMEPAD_SDL2_H
+#define __TEST_GAMEPAD_SDL2_H
+
+#include <SDL2/SDL.h>
+
+// Input event output formats, see SDL2_Output_Init()
+#define OUTPUT_TEXT   0
+#define OUTPUT_JSONL  1
+#define OUTPUT_CSV    2
+#define OUTPUT_BINARY 3
+
+extern int SDL_dead_zone;
+
+// Returns 1 if an axis value is outside the dead zone and must be reported.
+static inline int SDL2_Dead_Zone_Passes(Sint16 value)
+{
+	return value > SDL_dead_zone || value < -SDL_dead_zone;
+}
+
+// xorshift32, benchmarks must be repeatable
+static inline Uint32 SDL2_Random(Uint32 *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+
+	return *state;
+}
+
+int SDL2_Process_Event(const SDL_Event *ev);
+void SDL2_Output_Init(int format, FILE *stream);
+void SDL2_Output_Flush(void);
+
+#endif